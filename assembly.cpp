@@ -0,0 +1,190 @@
+#include "assembly.h"
+#include <cassert>
+
+std::optional<Condition> comparison(const Node &node) {
+	switch (node.type) {
+	case Node::node_type::equal:
+		return Condition::e;
+	case Node::node_type::not_equal:
+		return Condition::ne;
+	case Node::node_type::greater_equal:
+		return Condition::ge;
+	case Node::node_type::less_equal:
+		return Condition::le;
+	case Node::node_type::greater:
+		return Condition::g;
+	case Node::node_type::less:
+		return Condition::l;
+	default:
+		return std::nullopt;
+	}
+}
+
+static constexpr const char *register_names[] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15"};
+static constexpr const char *register_8bit_names[] = {
+    "al",  "cl",  "dl",   "bl",   "spl",  "bpl",  "sil",  "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+
+static const char *condition_name(Condition condition) {
+	switch (condition) {
+	case Condition::l:
+		return "l";
+	case Condition::ge:
+		return "ge";
+	case Condition::le:
+		return "le";
+	case Condition::g:
+		return "g";
+	case Condition::e:
+		return "e";
+	case Condition::ne:
+		return "ne";
+	}
+	assert(false);
+	return "";
+}
+
+static const char *opcode_name(Instruction::opcode_type opcode) {
+	switch (opcode) {
+	case Instruction::opcode_type::mov:
+		return "mov";
+	case Instruction::opcode_type::movzx:
+		return "movzx";
+	case Instruction::opcode_type::lea:
+		return "lea";
+	case Instruction::opcode_type::push:
+		return "push";
+	case Instruction::opcode_type::pop:
+		return "pop";
+	case Instruction::opcode_type::add:
+		return "add";
+	case Instruction::opcode_type::sub:
+		return "sub";
+	case Instruction::opcode_type::imul:
+	case Instruction::opcode_type::imul_high:
+		return "imul";
+	case Instruction::opcode_type::idiv:
+		return "idiv";
+	case Instruction::opcode_type::cqo:
+		return "cqo";
+	case Instruction::opcode_type::neg:
+		return "neg";
+	case Instruction::opcode_type::shl:
+		return "shl";
+	case Instruction::opcode_type::sar:
+		return "sar";
+	case Instruction::opcode_type::shr:
+		return "shr";
+	case Instruction::opcode_type::cmp:
+		return "cmp";
+	case Instruction::opcode_type::test:
+		return "test";
+	case Instruction::opcode_type::jmp:
+		return "jmp";
+	case Instruction::opcode_type::call:
+		return "call";
+	case Instruction::opcode_type::ret:
+		return "ret";
+	default:
+		assert(false);
+		return "";
+	}
+}
+
+static void write_operand(const Assembly &assembly, const Operand &operand,
+                          Emitter &out) {
+	const auto base = static_cast<std::size_t>(operand.base);
+
+	switch (operand.kind) {
+	case Operand::kind_type::reg:
+		out << register_names[base];
+		return;
+	case Operand::kind_type::reg8:
+		out << register_8bit_names[base];
+		return;
+	case Operand::kind_type::imm:
+		out << operand.imm;
+		return;
+	case Operand::kind_type::mem:
+		out << "[" << register_names[base];
+		if (operand.disp > 0) {
+			out << "+" << operand.disp;
+		} else if (operand.disp < 0) {
+			out << operand.disp;
+		}
+		out << "]";
+		return;
+	case Operand::kind_type::label:
+		out << assembly.label_names[operand.label];
+		return;
+	case Operand::kind_type::symbol:
+		out << operand.symbol;
+		return;
+	case Operand::kind_type::none:
+		assert(false);
+		return;
+	}
+}
+
+void Assembly::append(const Assembly &other) {
+	const auto label_base = static_cast<std::uint32_t>(label_names.size());
+	label_names.insert(label_names.end(), other.label_names.begin(),
+	                   other.label_names.end());
+
+	for (auto instruction : other.instructions) {
+		for (auto *operand : {&instruction.dst, &instruction.src}) {
+			if (Operand::kind_type::label == operand->kind) {
+				operand->label += label_base;
+			}
+		}
+		instructions.push_back(instruction);
+	}
+}
+
+void write_text(const Assembly &assembly, Emitter &out) {
+	out << ".intel_syntax noprefix\n";
+
+	for (const auto &instruction : assembly.instructions) {
+		switch (instruction.opcode) {
+		case Instruction::opcode_type::label:
+			write_operand(assembly, instruction.dst, out);
+			out << ":\n";
+			continue;
+		case Instruction::opcode_type::function:
+			if (is_global_function(instruction.dst.symbol)) {
+				out << ".global " << instruction.dst.symbol << "\n";
+			}
+			out << instruction.dst.symbol << ":\n";
+			continue;
+		case Instruction::opcode_type::set:
+			out << "	set" << condition_name(instruction.condition);
+			break;
+		case Instruction::opcode_type::jcc:
+			out << "	j" << condition_name(instruction.condition);
+			break;
+		default:
+			out << "	" << opcode_name(instruction.opcode);
+			break;
+		}
+
+		if (Operand::kind_type::none != instruction.dst.kind) {
+			out << " ";
+			// レジスタの無い命令（mov [rbp-8], 3 など）は大きさを明示する
+			if (Operand::kind_type::mem == instruction.dst.kind &&
+			    Operand::kind_type::reg != instruction.src.kind) {
+				out << "QWORD PTR ";
+			}
+			write_operand(assembly, instruction.dst, out);
+		}
+		if (Operand::kind_type::none != instruction.src.kind) {
+			out << ", ";
+			write_operand(assembly, instruction.src, out);
+		}
+		out << "\n";
+	}
+
+	// 実行可能スタックを要求しない
+	out << ".section .note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,288 @@
+#ifndef INCLUDE_GUARD_ASSEMBLY_
+#define INCLUDE_GUARD_ASSEMBLY_
+
+#include "ast.h"
+#include "emitter.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// x86-64 general purpose registers (in encoding order)
+enum class Register : std::uint8_t {
+	rax,
+	rcx,
+	rdx,
+	rbx,
+	rsp,
+	rbp,
+	rsi,
+	rdi,
+	r8,
+	r9,
+	r10,
+	r11,
+	r12,
+	r13,
+	r14,
+	r15
+};
+
+// condition of setcc / jcc (value is the condition code of the encoding)
+enum class Condition : std::uint8_t {
+	l  = 0xC, // <
+	ge = 0xD, // >=
+	le = 0xE, // <=
+	g  = 0xF, // >
+	e  = 0x4, // ==
+	ne = 0x5  // !=
+};
+
+// condition that holds exactly when condition does not
+inline Condition negate(Condition condition) {
+	switch (condition) {
+	case Condition::l:
+		return Condition::ge;
+	case Condition::ge:
+		return Condition::l;
+	case Condition::le:
+		return Condition::g;
+	case Condition::g:
+		return Condition::le;
+	case Condition::e:
+		return Condition::ne;
+	case Condition::ne:
+		return Condition::e;
+	}
+	return condition;
+}
+
+// condition of a comparison operator node (nullopt if not a comparison)
+std::optional<Condition> comparison(const Node &node);
+
+// local label (index of Assembly::label_names)
+struct Label {
+	std::uint32_t id;
+};
+
+struct Operand {
+	enum class kind_type : std::uint8_t {
+		none,
+		reg,    // 64 bit register
+		reg8,   // low 8 bit of register
+		imm,    // immediate
+		mem,    // [base + disp]
+		label,  // local label
+		symbol  // function
+	};
+	kind_type kind = kind_type::none;
+	Register  base = Register::rax; // reg, reg8, mem
+	union {
+		std::int64_t  imm; // imm
+		std::int32_t  disp; // mem
+		std::uint32_t label; // label
+		Symbol        symbol; // symbol
+	};
+
+	Operand()
+	    : imm(0) {}
+	Operand(Register reg)
+	    : kind(kind_type::reg)
+	    , base(reg)
+	    , imm(0) {}
+	Operand(std::int64_t value)
+	    : kind(kind_type::imm)
+	    , imm(value) {}
+	Operand(Label label)
+	    : kind(kind_type::label)
+	    , label(label.id) {}
+	Operand(Symbol symbol)
+	    : kind(kind_type::symbol)
+	    , symbol(symbol) {}
+};
+
+// low 8 bit of reg (al, bl, r12b, ...)
+inline Operand byte(Register reg) {
+	Operand operand(reg);
+	operand.kind = Operand::kind_type::reg8;
+	return operand;
+}
+// memory at [base + disp]
+inline Operand memory(Register base, std::int32_t disp = 0) {
+	Operand operand(base);
+	operand.kind = Operand::kind_type::mem;
+	operand.disp = disp;
+	return operand;
+}
+
+struct Instruction {
+	enum class opcode_type : std::uint8_t {
+		mov,
+		movzx,
+		lea,
+		push,
+		pop,
+		add,
+		sub,
+		imul,
+		imul_high, // rdx:rax = rax * dst
+		idiv,
+		cqo,
+		neg,
+		shl,
+		sar,
+		shr,
+		cmp,
+		test,
+		set,      // setcc
+		jmp,
+		jcc,      // conditional jump
+		call,
+		ret,
+		label,    // definition of local label (not an instruction)
+		function, // definition of function symbol (not an instruction)
+	};
+	opcode_type opcode;
+	Condition   condition = Condition::e; // set, jcc
+	Operand     dst;
+	Operand     src;
+};
+
+/**
+ * instruction list of a translation unit
+ * backends append instructions, and they are written out as text
+ * (write_text) or encoded to machine code (encoder.h)
+ */
+class Assembly {
+public:
+	std::vector<Instruction> instructions;
+	std::vector<std::string> label_names;
+
+	Label new_label(std::string name) {
+		label_names.push_back(std::move(name));
+		return Label{static_cast<std::uint32_t>(label_names.size() - 1)};
+	}
+	// label in the namespace of function (.L<function>.<kind><number>), so
+	// the code of a function does not depend on the other functions
+	Label new_label(Symbol function, std::string_view kind,
+	                std::uint32_t number) {
+		return new_label(".L" + std::string(function.str()) + "." +
+		                 std::string(kind) + std::to_string(number));
+	}
+
+	void emit(Instruction::opcode_type opcode, Operand dst = {},
+	          Operand src = {}) {
+		instructions.push_back(Instruction{opcode, Condition::e, dst, src});
+	}
+	void emit(Instruction::opcode_type opcode, Condition condition,
+	          Operand dst) {
+		instructions.push_back(Instruction{opcode, condition, dst, {}});
+	}
+
+	void mov(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::mov, dst, src);
+	}
+	void movzx(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::movzx, dst, src);
+	}
+	void lea(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::lea, dst, src);
+	}
+	void push(Operand src) {
+		emit(Instruction::opcode_type::push, src);
+	}
+	void pop(Operand dst) {
+		emit(Instruction::opcode_type::pop, dst);
+	}
+	void add(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::add, dst, src);
+	}
+	void sub(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::sub, dst, src);
+	}
+	void imul(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::imul, dst, src);
+	}
+	// rdx = high 64 bit of signed rax * src (rax = low 64 bit)
+	void imul_high(Operand src) {
+		emit(Instruction::opcode_type::imul_high, src);
+	}
+	void idiv(Operand src) {
+		emit(Instruction::opcode_type::idiv, src);
+	}
+	void cqo() {
+		emit(Instruction::opcode_type::cqo);
+	}
+	void neg(Operand dst) {
+		emit(Instruction::opcode_type::neg, dst);
+	}
+	void shl(Operand dst, std::int64_t count) {
+		emit(Instruction::opcode_type::shl, dst, count);
+	}
+	void sar(Operand dst, std::int64_t count) {
+		emit(Instruction::opcode_type::sar, dst, count);
+	}
+	void shr(Operand dst, std::int64_t count) {
+		emit(Instruction::opcode_type::shr, dst, count);
+	}
+	void cmp(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::cmp, dst, src);
+	}
+	void test(Operand dst, Operand src) {
+		emit(Instruction::opcode_type::test, dst, src);
+	}
+	void set(Condition condition, Operand dst) {
+		emit(Instruction::opcode_type::set, condition, dst);
+	}
+	void jmp(Label label) {
+		emit(Instruction::opcode_type::jmp, label);
+	}
+	// tail call (the frame is already torn down)
+	void jmp(Symbol function) {
+		emit(Instruction::opcode_type::jmp, function);
+	}
+	void j(Condition condition, Label label) {
+		emit(Instruction::opcode_type::jcc, condition, label);
+	}
+	void call(Symbol function) {
+		emit(Instruction::opcode_type::call, function);
+	}
+	void ret() {
+		emit(Instruction::opcode_type::ret);
+	}
+	void bind(Label label) {
+		emit(Instruction::opcode_type::label, label);
+	}
+	void function(Symbol name) {
+		emit(Instruction::opcode_type::function, name);
+	}
+
+	// append instructions of other (its labels are renumbered after ours)
+	void append(const Assembly &other);
+};
+
+// value of number node (folded constants may be negative)
+// wraps around beyond 64 bit
+inline std::int64_t number_value(Symbol number) {
+	auto       digits   = number.str();
+	const bool negative = digits.starts_with('-');
+	if (negative) {
+		digits.remove_prefix(1);
+	}
+	std::uint64_t value = 0;
+	for (const char digit : digits) {
+		value = value * 10 + static_cast<std::uint64_t>(digit - '0');
+	}
+	return static_cast<std::int64_t>(negative ? 0 - value : value);
+}
+
+// only main is visible from other translation units
+inline bool is_global_function(Symbol name) {
+	return name.str() == "main";
+}
+
+// write out as GNU assembler source (Intel syntax)
+void write_text(const Assembly &assembly, Emitter &out);
+
+#endif
@@ -0,0 +1,69 @@
+#include "ast.h"
+#include <algorithm>
+#include <cstring>
+
+void *Arena::allocate(std::size_t size, std::size_t alignment) {
+	auto padding = static_cast<std::size_t>(
+	    -reinterpret_cast<std::uintptr_t>(current) & (alignment - 1));
+
+	if (padding + size > remaining) {
+		// 大きな要求は専用のブロックにして、今のブロックの残りは使い続ける
+		if (size + alignment > block_size / 4) {
+			blocks.push_back(
+			    std::make_unique_for_overwrite<std::byte[]>(size + alignment));
+			void *      block       = blocks.back().get();
+			std::size_t block_space = size + alignment;
+			return std::align(alignment, size, block, block_space);
+		}
+
+		blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(block_size));
+		current   = blocks.back().get();
+		remaining = block_size;
+		padding   = static_cast<std::size_t>(
+		    -reinterpret_cast<std::uintptr_t>(current) & (alignment - 1));
+	}
+
+	auto memory = current + padding;
+	current += padding + size;
+	remaining -= padding + size;
+	return memory;
+}
+
+Symbol Interner::intern(std::string_view text) {
+	if (auto found = entries.find(text); found != entries.end()) {
+		return Symbol(found->second);
+	}
+
+	// 文字列も arena に置く（キーはその文字列を参照する）
+	auto copied = static_cast<char *>(arena.allocate(text.size() + 1, 1));
+	std::memcpy(copied, text.data(), text.size());
+	copied[text.size()] = '\0';
+
+	const auto entry = arena.create<Symbol::Entry>(Symbol::Entry{
+	    std::string_view(copied, text.size()),
+	    static_cast<std::uint32_t>(entries.size())});
+	entries.emplace(entry->text, entry);
+	return Symbol(entry);
+}
+
+Node *SyntaxTree::copy(const Node &node) {
+	assert(Node::node_type::function != node.type);
+
+	std::vector<Node *> children;
+	for (const auto &child : node.child) {
+		children.push_back(copy(*child));
+	}
+	return new_node(node.type, children, node.value);
+}
+
+std::size_t count_nodes(const Node &node) {
+	std::size_t count = 1;
+	for (const auto &child : node.child) {
+		count += count_nodes(*child);
+	}
+	return count;
+}
+
+std::ostream &operator<<(std::ostream &stream, Symbol symbol) {
+	return stream << symbol.str();
+}
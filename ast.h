@@ -0,0 +1,289 @@
+#ifndef INCLUDE_GUARD_AST_
+#define INCLUDE_GUARD_AST_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * bump allocator
+ * everything allocated from an arena is freed at once when it is destroyed,
+ * so only trivially destructible objects can be created in it
+ */
+class Arena {
+private:
+	static constexpr std::size_t block_size = 64 * 1024;
+
+	std::vector<std::unique_ptr<std::byte[]>> blocks;
+	std::byte *                               current   = nullptr;
+	std::size_t                               remaining = 0;
+
+public:
+	Arena()              = default;
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	void *allocate(std::size_t size, std::size_t alignment);
+
+	template <typename T, typename... Args>
+	T *create(Args &&... args) {
+		static_assert(std::is_trivially_destructible_v<T>);
+		return new (allocate(sizeof(T), alignof(T)))
+		    T(std::forward<Args>(args)...);
+	}
+
+	// copy elements into the arena
+	template <typename T>
+	std::span<T> copy(std::span<const T> elements) {
+		static_assert(std::is_trivially_copyable_v<T>);
+		if (elements.empty()) {
+			return {};
+		}
+		auto first = static_cast<T *>(
+		    allocate(sizeof(T) * elements.size(), alignof(T)));
+		std::uninitialized_copy(elements.begin(), elements.end(), first);
+		return {first, elements.size()};
+	}
+};
+
+/**
+ * interned string
+ * symbols with the same text share one entry, so they are compared by
+ * pointer and identified by a dense id
+ */
+class Symbol {
+public:
+	struct Entry {
+		std::string_view text;
+		std::uint32_t    id;
+	};
+
+private:
+	const Entry *entry = nullptr;
+
+public:
+	Symbol() = default;
+	explicit Symbol(const Entry *entry)
+	    : entry(entry) {}
+
+	std::string_view str() const {
+		return entry ? entry->text : std::string_view();
+	}
+	std::uint32_t id() const {
+		assert(entry);
+		return entry->id;
+	}
+	explicit operator bool() const {
+		return entry != nullptr;
+	}
+	bool operator==(const Symbol &) const = default;
+};
+std::ostream &operator<<(std::ostream &stream, Symbol symbol);
+
+template <>
+struct std::hash<Symbol> {
+	std::size_t operator()(Symbol symbol) const noexcept {
+		return symbol.id();
+	}
+};
+
+// pool of symbols whose texts and entries live in an arena
+class Interner {
+private:
+	Arena &                                                arena;
+	std::unordered_map<std::string_view, const Symbol::Entry *> entries;
+
+public:
+	explicit Interner(Arena &arena)
+	    : arena(arena) {}
+
+	Symbol intern(std::string_view text);
+	// number of distinct symbols (ids are 0 to size() - 1)
+	std::size_t size() const {
+		return entries.size();
+	}
+};
+
+struct Node;
+
+// children of a node (a range of node pointers in the arena)
+class NodeList {
+private:
+	Node **       first = nullptr;
+	std::uint32_t count = 0;
+
+public:
+	using iterator               = Node **;
+	using const_iterator         = Node *const *;
+	using reverse_iterator       = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	NodeList() = default;
+	NodeList(std::span<Node *> nodes)
+	    : first(nodes.data())
+	    , count(static_cast<std::uint32_t>(nodes.size())) {}
+
+	std::size_t size() const {
+		return count;
+	}
+	bool empty() const {
+		return count == 0;
+	}
+	Node *&operator[](std::size_t index) {
+		assert(index < count);
+		return first[index];
+	}
+	Node *operator[](std::size_t index) const {
+		assert(index < count);
+		return first[index];
+	}
+	Node *front() const {
+		return (*this)[0];
+	}
+	Node *back() const {
+		return (*this)[count - 1];
+	}
+
+	iterator begin() {
+		return first;
+	}
+	iterator end() {
+		return first + count;
+	}
+	const_iterator begin() const {
+		return first;
+	}
+	const_iterator end() const {
+		return first + count;
+	}
+	const_reverse_iterator rbegin() const {
+		return const_reverse_iterator(end());
+	}
+	const_reverse_iterator rend() const {
+		return const_reverse_iterator(begin());
+	}
+};
+
+struct Node {
+	enum class node_type : std::uint8_t {
+		function,       // function-definition
+		call,           // function-call
+		ifelse_,        // if-else
+		if_,            // if
+		for_,           // for
+		while_,         // while
+		statements,     // compound statements
+		empty,          // empty statement
+		return_,        // return
+		assign,         // =
+		equal,          // ==
+		not_equal,      // !=
+		greater_equal,  // >=
+		less_equal,     // <=
+		greater,        // >
+		less,           // <
+		addition,       // binary +
+		subtraction,    // binary -
+		multiplication, // binary *
+		division,       // /
+		plus,           // unary +
+		minus,          // unary -
+		address,        // unary &
+		indirection,    // unary *
+		number,         // integer literal (negative only after constant folding)
+		identifier      // identifier
+	};
+	node_type type;
+	NodeList  child;
+	Symbol    value; // name of function or identifier, or number literal
+
+	Node(node_type type)
+	    : type(type) {}
+	Node(node_type type, NodeList child, Symbol value)
+	    : type(type)
+	    , child(child)
+	    , value(value) {}
+
+	// dummy argument names (type = function only)
+	std::span<const Symbol> parameters() const;
+};
+
+// function-definition node, the only node that has dummy arguments
+struct FunctionNode : Node {
+	std::span<const Symbol> parameter_list;
+
+	FunctionNode(NodeList child, Symbol name,
+	             std::span<const Symbol> parameter_list)
+	    : Node(node_type::function, child, name)
+	    , parameter_list(parameter_list) {}
+};
+
+inline std::span<const Symbol> Node::parameters() const {
+	assert(node_type::function == type);
+	return static_cast<const FunctionNode *>(this)->parameter_list;
+}
+
+// number of nodes in the tree of node (node and all of its descendants)
+std::size_t count_nodes(const Node &node);
+
+/**
+ * abstract syntax tree
+ * all nodes, child lists and symbols are allocated in one arena and are
+ * freed together with the tree
+ */
+class SyntaxTree {
+private:
+	Arena    arena;
+	Interner interner{arena};
+
+public:
+	Node *root = nullptr;
+
+	SyntaxTree()                   = default;
+	SyntaxTree(const SyntaxTree &) = delete;
+	SyntaxTree &operator=(const SyntaxTree &) = delete;
+
+	Symbol intern(std::string_view text) {
+		return interner.intern(text);
+	}
+	// number of distinct symbols (ids are 0 to symbol_count() - 1)
+	std::size_t symbol_count() const {
+		return interner.size();
+	}
+
+	NodeList new_list(std::span<Node *const> nodes) {
+		return arena.copy(nodes);
+	}
+	Node *new_node(Node::node_type type, Symbol value = {}) {
+		return arena.create<Node>(type, NodeList(), value);
+	}
+	Node *new_node(Node::node_type type, std::span<Node *const> children,
+	               Symbol value = {}) {
+		return arena.create<Node>(type, new_list(children), value);
+	}
+	// children already allocated by new_list() are adopted without a copy
+	Node *new_node(Node::node_type type, NodeList children, Symbol value = {}) {
+		return arena.create<Node>(type, children, value);
+	}
+	Node *new_function(Symbol name, std::span<const Symbol> parameters,
+	                   Node *body) {
+		Node *const children[] = {body};
+		return arena.create<FunctionNode>(new_list(children), name,
+		                                  arena.copy(parameters));
+	}
+	// deep copy of node (a statement or expression, not a function)
+	Node *copy(const Node &node);
+};
+
+#endif
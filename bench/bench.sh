@@ -0,0 +1,58 @@
+#!/bin/bash
+# コンパイラ自体の処理速度を計測する（make bench）
+# 合成プログラムを大きさを変えてコンパイルし、各フェーズの時間・スループット・
+# 確保量・ピーク RSS を bench/results/<commit>.tsv に書き出す
+# (コミット間の比較には同じ SIZES で計測したものを diff / join する)
+#
+# environment:
+#   SIZES     大きさの倍率のリスト（既定 "1 2 4 8"）
+#   BACKENDS  計測するバックエンド（既定 "stack register"）
+#   OUTPUT    結果のファイル（既定 bench/results/<commit>.tsv）
+bench_dir="$(dirname "$0")"
+compiler="$bench_dir/../9cc"
+
+sizes=${SIZES:-"1 2 4 8"}
+backends=${BACKENDS:-"stack register"}
+commit="$(git -C "$bench_dir" rev-parse --short HEAD 2>/dev/null || echo unknown)"
+if [ -n "$(git -C "$bench_dir/.." status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+	commit="$commit-dirty"
+fi
+output=${OUTPUT:-"$bench_dir/results/$commit.tsv"}
+mkdir -p "$(dirname "$output")"
+
+# 倍率 1 の時の各形の大きさ
+declare -A base_size=(
+	[functions]=1000
+	[chain]=20000
+	[locals]=2000
+	[nesting]=300
+	[lines]=20000
+)
+
+source_file="$(mktemp)"
+stats_file="$(mktemp)"
+trap 'rm -f "$source_file" "$stats_file"' EXIT
+
+echo -e "commit\tbackend\tshape\tsize\tsource_bytes\tphase\tcalls\ttime_ms\tallocs\talloc_bytes\tpeak_rss_kib\twork\tunit\tper_second" > "$output"
+for shape in functions chain locals nesting lines; do
+	for scale in $sizes; do
+		size=$((base_size[$shape] * scale))
+		"$bench_dir/generate.sh" $shape $size > "$source_file" || exit 1
+		bytes=$(wc -c < "$source_file")
+		for backend in $backends; do
+			if ! "$compiler" --backend=$backend --stats=tsv -o /dev/null -f "$source_file" 2> "$stats_file"; then
+				echo "[$backend] $shape $size: compilation failed"
+				cat "$stats_file"
+				exit 1
+			fi
+			# ヘッダを除いて、条件の列を前に付ける
+			tail -n +2 "$stats_file" | sed "s/^/$commit\t$backend\t$shape\t$size\t$bytes\t/" >> "$output"
+			awk -F'\t' -v label="[$backend] $shape $size ($bytes bytes)" '
+				{ total += $3; if ($6 > rss) rss = $6 }
+				$8 != "-" { rates = rates sprintf("  %s %.0f %s/s", $1, $9, $8) }
+				END { printf "%-40s %9.1f ms  %7d KiB%s\n", label, total, rss, rates }
+			' <(tail -n +2 "$stats_file" | grep -v "^codegen (functions)")
+		done
+	done
+done
+echo "results: $output"
@@ -0,0 +1,83 @@
+#!/bin/bash
+# 計測用の合成プログラムを生成する（C.ebnf の文法の範囲）
+# usage: generate.sh SHAPE SIZE
+#   functions  SIZE 個の関数
+#   chain      1 行に SIZE 項の長い式
+#   locals     SIZE 個のローカル変数
+#   nesting    深さ SIZE の if/while/for の入れ子
+#   lines      SIZE 行の文
+shape="$1"
+size="$2"
+if [ -z "$shape" ] || [ -z "$size" ]; then
+	echo "usage: $0 functions|chain|locals|nesting|lines SIZE" >&2
+	exit 1
+fi
+
+awk -v shape="$shape" -v size="$size" '
+BEGIN {
+	if (shape == "functions") {
+		for (i = 0; i < size; ++i) {
+			printf "f%d(a, b){ c = a + b * %d; if (c > %d) return c - a; return c; }\n", i, i, i
+		}
+		print "main(){ return f0(1, 2) - 3; }"
+	} else if (shape == "chain") {
+		printf "main(){ x = 1; return x"
+		open = 0
+		for (i = 1; i < size; ++i) {
+			op = substr("+-*+", i % 4 + 1, 1)
+			# 8 項ごとに括弧で入れ子にする
+			if (i % 8 == 0) {
+				printf " %s (x", op
+				++open
+			} else if (i % 8 == 7 && open > 0) {
+				printf " %s %d)", op, i
+				--open
+			} else {
+				printf " %s %d", op, i
+			}
+		}
+		for (; open > 0; --open) {
+			printf ")"
+		}
+		print " - x; }"
+	} else if (shape == "locals") {
+		print "main(){"
+		for (i = 0; i < size; ++i) {
+			printf "\tv%d = %d;\n", i, i
+		}
+		print "\ts = 0;"
+		for (i = 0; i < size; ++i) {
+			printf "\ts = s + v%d;\n", i
+		}
+		print "\treturn s - s;"
+		print "}"
+	} else if (shape == "nesting") {
+		print "main(){ x = 0; i = 0;"
+		for (i = 0; i < size; ++i) {
+			kind = i % 3
+			if (kind == 0) {
+				printf "if (x >= 0) {"
+			} else if (kind == 1) {
+				printf "while (x < %d) {", i
+			} else {
+				printf "for (i = 0; i < 1; i = i + 1) {"
+			}
+			print " x = x + 1;"
+		}
+		for (i = 0; i < size; ++i) {
+			printf "}"
+		}
+		print "\nreturn 0; }"
+	} else if (shape == "lines") {
+		print "main(){"
+		print "\tx = 0;"
+		for (i = 0; i < size; ++i) {
+			printf "\tx = x + %d * 2 - %d;\n", i, i
+		}
+		print "\treturn x - x;"
+		print "}"
+	} else {
+		print "unknown shape: " shape > "/dev/stderr"
+		exit 1
+	}
+}'
@@ -0,0 +1,99 @@
+#!/bin/bash
+# 9cc が生成したコードの実行速度を計測する（make bench-runtime）
+# bench/runtime/<name>.9cc を各バックエンドで、同じ計算の <name>.c を
+# cc -O0 / -O2 でビルドし、それぞれ RUNS 回実行した時間を
+# bench/results/runtime-<commit>.tsv に書き出す
+# 終了コード（計算結果）は cc -O0 と一致しなければならない
+#
+# environment:
+#   RUNS      各プログラムの実行回数（既定 5）
+#   PROGRAMS  計測するプログラム（既定 bench/runtime/*.9cc 全て）
+#   OUTPUT    結果のファイル（既定 bench/results/runtime-<commit>.tsv）
+bench_dir="$(dirname "$0")"
+compiler="$bench_dir/../9cc"
+
+runs=${RUNS:-5}
+programs=${PROGRAMS:-$(basename -s .9cc "$bench_dir"/runtime/*.9cc)}
+commit="$(git -C "$bench_dir" rev-parse --short HEAD 2>/dev/null || echo unknown)"
+if [ -n "$(git -C "$bench_dir/.." status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+	commit="$commit-dirty"
+fi
+output=${OUTPUT:-"$bench_dir/results/runtime-$commit.tsv"}
+mkdir -p "$(dirname "$output")"
+
+work_dir="$(mktemp -d)"
+trap 'rm -rf "$work_dir"' EXIT
+
+# build BUILDER SOURCE(拡張子なし) EXECUTABLE
+builders=("9cc-stack" "9cc-register" "9cc-ssa" "9cc-vm" "cc-O0" "cc-O2")
+build() {
+	case "$1" in
+	9cc-vm)
+		# 実行のたびに bytecode に変換して VM で実行する
+		printf '#!/bin/sh\nexec "%s" --vm -f "%s"\n' "$(realpath "$compiler")" "$(realpath "$2.9cc")" > "$3" && chmod +x "$3"
+		;;
+	9cc-*)
+		"$compiler" --backend=${1#9cc-} -o "$3.s" -f "$2.9cc" && cc -o "$3" "$3.s"
+		;;
+	cc-*)
+		cc -${1#cc-} -o "$3" "$2.c"
+		;;
+	esac
+}
+
+now_ns() {
+	date +%s%N
+}
+
+echo -e "commit\tprogram\tbuild\truns\tresult\tmin_ms\tmean_ms\tratio_to_cc_O0" > "$output"
+status=0
+for program in $programs; do
+	expected=""
+	reference_ms=""
+	# cc -O0 を先に計測して基準にする
+	for builder in cc-O0 "${builders[@]}"; do
+		if [ "$builder" == cc-O0 ] && [ -n "$reference_ms" ]; then
+			continue
+		fi
+		executable="$work_dir/$program-$builder"
+		if ! build $builder "$bench_dir/runtime/$program" "$executable"; then
+			echo "[$builder] $program: build failed"
+			status=1
+			continue
+		fi
+
+		min_ns=""
+		total_ns=0
+		for ((run = 0; run < runs; ++run)); do
+			start=$(now_ns)
+			"$executable"
+			result=$?
+			elapsed=$(($(now_ns) - start))
+			total_ns=$((total_ns + elapsed))
+			if [ -z "$min_ns" ] || [ $elapsed -lt $min_ns ]; then
+				min_ns=$elapsed
+			fi
+		done
+
+		if [ -z "$expected" ]; then
+			expected=$result
+			reference_ms=$(awk -v ns=$min_ns 'BEGIN { printf "%.3f", ns / 1e6 }')
+		elif [ "$result" != "$expected" ]; then
+			echo "[$builder] $program => $expected expected, but got $result"
+			status=1
+		fi
+
+		awk -v commit="$commit" -v program="$program" -v builder="$builder" \
+		    -v runs=$runs -v result=$result -v min_ns=$min_ns \
+		    -v total_ns=$total_ns -v reference_ms=$reference_ms -v output="$output" '
+		BEGIN {
+			min_ms = min_ns / 1e6
+			mean_ms = total_ns / runs / 1e6
+			ratio = reference_ms > 0 ? min_ms / reference_ms : 0
+			printf "%s\t%s\t%s\t%d\t%d\t%.3f\t%.3f\t%.2f\n", commit, program, builder, runs, result, min_ms, mean_ms, ratio >> output
+			printf "%-10s %-14s %10.1f ms %10.1f ms  x%.2f\n", program, builder, min_ms, mean_ms, ratio
+		}'
+	done
+done
+echo "results: $output"
+exit $status
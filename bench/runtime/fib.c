@@ -0,0 +1,8 @@
+/* fib.9cc と同じ計算 */
+long fib(long n) {
+	if (n < 2) return n;
+	return fib(n - 1) + fib(n - 2);
+}
+int main(void) {
+	return fib(32) - fib(32) / 256 * 256;
+}
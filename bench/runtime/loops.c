@@ -0,0 +1,10 @@
+/* loops.9cc と同じ計算 */
+int main(void) {
+	long s = 0, i, j;
+	for (i = 0; i < 3000; i = i + 1) {
+		for (j = 0; j < 3000; j = j + 1) {
+			s = s + i * j - s / 3;
+		}
+	}
+	return s - s / 256 * 256;
+}
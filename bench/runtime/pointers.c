@@ -0,0 +1,15 @@
+/* pointers.9cc と同じ計算（9cc の変数はすべて 8 バイト） */
+int main(void) {
+	long a = 0, b = 0, c = 0, d = 0, p, n, i;
+	a = (long)&b;
+	b = (long)&c;
+	c = (long)&d;
+	d = (long)&a;
+	p = (long)&a;
+	n = 0;
+	for (i = 0; i < 20000000; i = i + 1) {
+		p = *(long *)p;
+		if (p == (long)&a) n = n + 1;
+	}
+	return n - n / 256 * 256;
+}
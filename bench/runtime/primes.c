@@ -0,0 +1,15 @@
+/* primes.9cc と同じ計算 */
+long is_prime(long n) {
+	long d;
+	for (d = 2; d * d <= n; d = d + 1) {
+		if (n / d * d == n) return 0;
+	}
+	return 1;
+}
+int main(void) {
+	long count = 0, n;
+	for (n = 2; n < 300000; n = n + 1) {
+		count = count + is_prime(n);
+	}
+	return count - count / 256 * 256;
+}
@@ -0,0 +1,356 @@
+#include "bytecode.h"
+#include "assembly.h" // number_value
+#include "error.h"
+#include "fold.h"
+#include "symbol_table.h"
+#include "tailcall.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+using opcode_type = BytecodeInstruction::opcode_type;
+
+namespace {
+// 関数の表（呼び出しの解決用）
+struct FunctionIndex {
+	std::unordered_map<Symbol, std::size_t> functions;
+	std::unordered_map<Symbol, std::size_t> externals;
+};
+
+// 生成中の関数の状態
+struct FunctionState {
+	BytecodeProgram &program;
+	FunctionIndex   &index;
+	SymbolTable      symbol_table; // ローカル変数
+	std::unordered_set<const Node *> tail_calls; // 末尾位置の呼び出し
+	std::size_t      depth     = 0; // 現在の値スタックの深さ
+	std::size_t      max_depth = 0;
+
+	void emit(opcode_type opcode, std::int32_t operand = 0,
+	          std::uint8_t arity = 0) {
+		program.code.push_back(BytecodeInstruction{opcode, arity, operand});
+
+		/* 値スタックの深さを追う */
+		switch (opcode) {
+		case opcode_type::constant:
+		case opcode_type::load:
+		case opcode_type::address:
+			++depth;
+			break;
+		case opcode_type::call:
+		case opcode_type::call_external:
+		case opcode_type::tail_call:
+			depth = depth - arity + 1;
+			break;
+		case opcode_type::assign_statement:
+		case opcode_type::add:
+		case opcode_type::subtract:
+		case opcode_type::multiply:
+		case opcode_type::divide:
+		case opcode_type::equal:
+		case opcode_type::not_equal:
+		case opcode_type::less:
+		case opcode_type::less_equal:
+		case opcode_type::greater:
+		case opcode_type::greater_equal:
+		case opcode_type::set_result:
+		case opcode_type::jump_if_zero:
+		case opcode_type::jump_if_nonzero:
+		case opcode_type::return_:
+			--depth;
+			break;
+		default:
+			break;
+		}
+		max_depth = std::max(max_depth, depth);
+	}
+
+	// jump to be patched later (returns its index)
+	std::size_t emit_jump(opcode_type opcode) {
+		emit(opcode);
+		return program.code.size() - 1;
+	}
+	// make the jump at index jump go to the next instruction
+	void patch(std::size_t jump) {
+		program.code[jump].operand = here();
+	}
+	std::int32_t here() const {
+		return static_cast<std::int32_t>(program.code.size());
+	}
+
+	std::int32_t offset(Symbol identifier) const {
+		return static_cast<std::int32_t>(symbol_table.offset(identifier));
+	}
+};
+} // namespace
+
+static void gen_expression(const Node &node, FunctionState &state);
+
+static opcode_type binary_opcode(Node::node_type type) {
+	switch (type) {
+	case Node::node_type::addition:
+		return opcode_type::add;
+	case Node::node_type::subtraction:
+		return opcode_type::subtract;
+	case Node::node_type::multiplication:
+		return opcode_type::multiply;
+	case Node::node_type::division:
+		return opcode_type::divide;
+	case Node::node_type::equal:
+		return opcode_type::equal;
+	case Node::node_type::not_equal:
+		return opcode_type::not_equal;
+	case Node::node_type::less:
+		return opcode_type::less;
+	case Node::node_type::less_equal:
+		return opcode_type::less_equal;
+	case Node::node_type::greater:
+		return opcode_type::greater;
+	case Node::node_type::greater_equal:
+		return opcode_type::greater_equal;
+	default:
+		return opcode_type::count;
+	}
+}
+
+static void gen_call(const Node &node, FunctionState &state) {
+	// ネイティブのバックエンドと同じく、引数はレジスタで渡せる 6 個まで
+	if (node.child.size() > 6) {
+		error("too many arguments to " + std::string(node.value.str()));
+	}
+	for (const auto &argument : node.child) {
+		gen_expression(*argument, state);
+	}
+
+	const auto arity = static_cast<std::uint8_t>(node.child.size());
+	if (auto found = state.index.functions.find(node.value);
+	    found != state.index.functions.end()) {
+		// 末尾呼び出しはフレームを使い回す（深い再帰でもフレームが増えない）
+		state.emit(state.tail_calls.contains(&node) ? opcode_type::tail_call
+		                                            : opcode_type::call,
+		           static_cast<std::int32_t>(found->second), arity);
+		return;
+	}
+
+	// プログラムで定義されていない関数は C の関数として呼ぶ
+	auto [external, inserted] = state.index.externals.emplace(
+	    node.value, state.program.externals.size());
+	if (inserted) {
+		state.program.externals.push_back({node.value});
+	}
+	state.emit(opcode_type::call_external,
+	           static_cast<std::int32_t>(external->second), arity);
+}
+
+// node を計算して値スタックに積む
+static void gen_expression(const Node &node, FunctionState &state) {
+	switch (node.type) {
+	case Node::node_type::number:
+		state.emit(opcode_type::constant,
+		           static_cast<std::int32_t>(state.program.constants.size()));
+		state.program.constants.push_back(number_value(node.value));
+		return;
+
+	case Node::node_type::identifier:
+		state.emit(opcode_type::load, state.offset(node.value));
+		return;
+
+	case Node::node_type::assign:
+		assert(node.child.size() == 2);
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		gen_expression(*node.child[1], state);
+		state.emit(opcode_type::store, state.offset(node.child[0]->value));
+		return;
+
+	case Node::node_type::address:
+		assert(node.child.size() == 1);
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		state.emit(opcode_type::address, state.offset(node.child[0]->value));
+		return;
+
+	case Node::node_type::indirection:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], state);
+		state.emit(opcode_type::indirection);
+		return;
+
+	case Node::node_type::plus:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], state);
+		return;
+
+	case Node::node_type::minus:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], state);
+		state.emit(opcode_type::negate);
+		return;
+
+	case Node::node_type::call:
+		gen_call(node, state);
+		return;
+
+	default:
+		break;
+	}
+
+	const auto opcode = binary_opcode(node.type);
+	if (opcode_type::count == opcode) {
+		error("not implemented type(" +
+		      std::to_string(static_cast<int>(node.type)) + ") on bytecode");
+	}
+	assert(node.child.size() == 2);
+
+	gen_expression(*node.child[0], state);
+	gen_expression(*node.child[1], state);
+	state.emit(opcode);
+}
+
+/**
+ * 式文
+ * 関数の末尾に return が無い場合の戻り値になるので set_result で残す
+ */
+static void gen_expression_statement(const Node &node, FunctionState &state) {
+	if (Node::node_type::empty == node.type) {
+		return;
+	}
+	if (Node::node_type::assign == node.type) {
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		gen_expression(*node.child[1], state);
+		state.emit(opcode_type::assign_statement,
+		           state.offset(node.child[0]->value));
+		return;
+	}
+	gen_expression(node, state);
+	state.emit(opcode_type::set_result);
+}
+
+static void gen_statement(const Node &node, FunctionState &state) {
+	switch (node.type) {
+	case Node::node_type::ifelse_: {
+		assert(node.child.size() == 3);
+
+		gen_expression(*node.child[0], state);
+		const auto to_else = state.emit_jump(opcode_type::jump_if_zero);
+		gen_statement(*node.child[1], state);
+		const auto to_end = state.emit_jump(opcode_type::jump);
+		state.patch(to_else);
+		gen_statement(*node.child[2], state);
+		state.patch(to_end);
+		return;
+	}
+
+	case Node::node_type::if_: {
+		assert(node.child.size() == 2);
+
+		gen_expression(*node.child[0], state);
+		const auto to_end = state.emit_jump(opcode_type::jump_if_zero);
+		gen_statement(*node.child[1], state);
+		state.patch(to_end);
+		return;
+	}
+
+	// 条件式を末尾に置き、1 周あたりの分岐を 1 回にする
+	case Node::node_type::while_:
+	case Node::node_type::for_: {
+		const bool  is_for    = Node::node_type::for_ == node.type;
+		const auto &condition = *node.child[is_for ? 1 : 0];
+		const auto &body      = *node.child[is_for ? 3 : 1];
+
+		assert(node.child.size() == (is_for ? 4 : 2));
+
+		if (is_for) {
+			gen_expression_statement(*node.child[0], state); // 初期化式
+		}
+		const bool always   = is_constant_true(condition);
+		const auto to_check = always ? 0 : state.emit_jump(opcode_type::jump);
+		const auto begin    = state.here();
+		gen_statement(body, state);
+		if (is_for) {
+			gen_expression_statement(*node.child[2], state); // 変化式
+		}
+		if (always) {
+			state.emit(opcode_type::jump, begin);
+		} else {
+			state.patch(to_check);
+			gen_expression(condition, state);
+			state.emit(opcode_type::jump_if_nonzero, begin);
+		}
+		return;
+	}
+
+	case Node::node_type::return_:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], state);
+		state.emit(opcode_type::return_);
+		return;
+
+	case Node::node_type::statements:
+		state.symbol_table.enter_block(node);
+		for (const auto &child : node.child) {
+			gen_statement(*child, state);
+		}
+		state.symbol_table.leave_block();
+		return;
+
+	default:
+		gen_expression_statement(node, state);
+		return;
+	}
+}
+
+BytecodeProgram compile_bytecode(const SyntaxTree &tree) {
+	BytecodeProgram program;
+	FunctionIndex   index;
+
+	// 後で定義される関数も呼べるように、先に全ての関数を登録する
+	const auto &functions = tree.root->child;
+	for (std::size_t i = 0; i < functions.size(); ++i) {
+		index.functions.emplace(functions[i]->value, i);
+	}
+
+	for (const auto &function : functions) {
+		assert(Node::node_type::function == function->type);
+		assert(function->child.size() == 1);
+		if (function->parameters().size() > 6) {
+			error("too many parameters of " +
+			      std::string(function->value.str()));
+		}
+
+		FunctionState state{program, index, SymbolTable(*function),
+		                    find_tail_calls(*function)};
+		const auto    entry = program.code.size();
+		gen_statement(*function->child[0], state);
+		state.emit(opcode_type::return_result);
+
+		std::vector<std::int32_t> parameter_offsets;
+		for (const auto parameter : function->parameters()) {
+			parameter_offsets.push_back(state.offset(parameter));
+		}
+		program.functions.push_back({function->value, entry,
+		                             state.symbol_table.frame_slots(),
+		                             state.max_depth,
+		                             std::move(parameter_offsets)});
+	}
+
+	if (program.code.size() >
+	    static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())) {
+		error("program is too large for bytecode");
+	}
+	auto main = std::find_if(
+	    program.functions.begin(), program.functions.end(),
+	    [](const auto &function) { return function.name.str() == "main"; });
+	if (main == program.functions.end()) {
+		error("main is not defined.");
+	}
+	program.main = main - program.functions.begin();
+	return program;
+}
@@ -0,0 +1,72 @@
+#ifndef INCLUDE_GUARD_BYTECODE_
+#define INCLUDE_GUARD_BYTECODE_
+
+#include "ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * bytecode of a stack machine (executed by vm.h without assembling)
+ * local variables live in a frame laid out like the native one:
+ * the variable at offset o of the symbol table is at frame_end - o
+ */
+struct BytecodeInstruction {
+	enum class opcode_type : std::uint8_t {
+		constant,         // push constants[operand]
+		load,             // push local variable at offset operand
+		store,            // local variable at offset operand = top (kept)
+		assign_statement, // local variable at offset operand = pop (also result)
+		address,          // push address of local variable at offset operand
+		indirection,      // top = *top
+		negate,           // top = -top
+		add,              // binary operators: pop right, then left, push result
+		subtract,
+		multiply,
+		divide,
+		equal,
+		not_equal,
+		less,
+		less_equal,
+		greater,
+		greater_equal,
+		set_result,      // result of the function falling off its end = pop
+		jump,            // pc = operand
+		jump_if_zero,    // pc = operand if pop == 0
+		jump_if_nonzero, // pc = operand if pop != 0
+		call,            // call functions[operand] with its arguments on stack
+		call_external,   // call externals[operand]
+		tail_call,       // call replacing the current frame (returns for it)
+		return_,         // return pop
+		return_result,   // return the value set by set_result
+		count            // number of opcodes (not an instruction)
+	};
+	opcode_type  opcode;
+	std::uint8_t arity   = 0; // number of arguments (call, call_external, tail_call)
+	std::int32_t operand = 0;
+};
+
+struct BytecodeProgram {
+	struct Function {
+		Symbol                    name;
+		std::size_t               entry;       // index of the first instruction
+		std::size_t               frame_slots; // 8 byte slots of variables
+		std::size_t               max_stack;   // deepest use of value stack
+		std::vector<std::int32_t> parameter_offsets;
+	};
+	// function not defined in the program (called through the C ABI)
+	struct External {
+		Symbol name;
+	};
+
+	std::vector<BytecodeInstruction> code;
+	std::vector<std::int64_t>        constants;
+	std::vector<Function>            functions;
+	std::vector<External>            externals;
+	std::size_t                      main = 0; // index of main in functions
+};
+
+// lower the syntax tree to bytecode (errors if main is not defined)
+BytecodeProgram compile_bytecode(const SyntaxTree &tree);
+
+#endif
@@ -0,0 +1,262 @@
+#include "cache.h"
+#include "error.h"
+#include <cassert>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+// 形式が変わったら上げる（古いキャッシュは使われなくなる）
+static constexpr std::string_view cache_header = "9cc-function-cache 3";
+
+/* FNV-1a */
+static constexpr std::uint64_t fnv_offset_basis = 0xcbf29ce484222325;
+static constexpr std::uint64_t fnv_prime        = 0x100000001b3;
+
+static void hash_bytes(std::uint64_t &hash, const void *data,
+                       std::size_t size) {
+	const auto bytes = static_cast<const unsigned char *>(data);
+	for (std::size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * fnv_prime;
+	}
+}
+static void hash_integer(std::uint64_t &hash, std::uint64_t value) {
+	hash_bytes(hash, &value, sizeof(value));
+}
+static void hash_symbol(std::uint64_t &hash, Symbol symbol) {
+	const auto text = symbol.str();
+	hash_integer(hash, text.size());
+	hash_bytes(hash, text.data(), text.size());
+}
+
+/**
+ * この実行ファイルのハッシュ
+ * 生成するコードはコンパイラ自身にもよるので、作り直したコンパイラは
+ * 以前のコンパイラのキャッシュを使わない
+ */
+static std::uint64_t compiler_identity() {
+	static const std::uint64_t identity = [] {
+		std::ifstream file("/proc/self/exe", std::ios::binary);
+		if (!file) {
+			error("cannot read the compiler itself for the cache key");
+		}
+		std::uint64_t hash = fnv_offset_basis;
+		char          buffer[1 << 16];
+		while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+			hash_bytes(hash, buffer, static_cast<std::size_t>(file.gcount()));
+		}
+		return hash;
+	}();
+	return identity;
+}
+
+static void hash_node(std::uint64_t &hash, const Node &node) {
+	hash_integer(hash, static_cast<std::uint64_t>(node.type));
+	hash_symbol(hash, node.value);
+	if (Node::node_type::function == node.type) {
+		hash_integer(hash, node.parameters().size());
+		for (const auto parameter : node.parameters()) {
+			hash_symbol(hash, parameter);
+		}
+	}
+	hash_integer(hash, node.child.size());
+	for (const auto &child : node.child) {
+		hash_node(hash, *child);
+	}
+}
+
+std::uint64_t hash_function(const Node &function, std::uint64_t seed) {
+	assert(Node::node_type::function == function.type);
+
+	std::uint64_t hash = fnv_offset_basis;
+	hash_bytes(hash, cache_header.data(), cache_header.size());
+	hash_integer(hash, compiler_identity());
+	hash_integer(hash, seed);
+	hash_node(hash, function);
+	return hash;
+}
+
+/**
+ * 1 行に 1 命令の文字列にする
+ * オペランドは - (なし), r<番号>, b<番号> (下位 8 bit), i<即値>,
+ * m<番号>,<変位>, l<ラベル>, s<関数名>
+ */
+static void write_operand(std::ostream &stream, const Operand &operand) {
+	const auto base = static_cast<int>(operand.base);
+	switch (operand.kind) {
+	case Operand::kind_type::none:
+		stream << '-';
+		return;
+	case Operand::kind_type::reg:
+		stream << 'r' << base;
+		return;
+	case Operand::kind_type::reg8:
+		stream << 'b' << base;
+		return;
+	case Operand::kind_type::imm:
+		stream << 'i' << operand.imm;
+		return;
+	case Operand::kind_type::mem:
+		stream << 'm' << base << ',' << operand.disp;
+		return;
+	case Operand::kind_type::label:
+		stream << 'l' << operand.label;
+		return;
+	case Operand::kind_type::symbol:
+		stream << 's' << operand.symbol.str();
+		return;
+	}
+}
+
+static bool read_operand(std::istream &stream, std::uint32_t label_base,
+                         const std::function<Symbol(std::string_view)> &intern,
+                         Operand &operand) {
+	std::string text;
+	if (!(stream >> text) || text.empty()) {
+		return false;
+	}
+	std::istringstream value(text.substr(1));
+	int                base = 0;
+	char               comma;
+	switch (text.front()) {
+	case '-':
+		operand = Operand();
+		return true;
+	case 'r':
+	case 'b':
+		if (!(value >> base) || base < 0 || base > 15) {
+			return false;
+		}
+		operand = 'r' == text.front() ? Operand(static_cast<Register>(base))
+		                              : byte(static_cast<Register>(base));
+		return true;
+	case 'i':
+		operand = Operand(std::int64_t{0});
+		return static_cast<bool>(value >> operand.imm);
+	case 'm':
+		if (!(value >> base >> comma) || base < 0 || base > 15) {
+			return false;
+		}
+		operand = memory(static_cast<Register>(base));
+		return static_cast<bool>(value >> operand.disp);
+	case 'l':
+		operand = Operand(Label{0});
+		if (!(value >> operand.label)) {
+			return false;
+		}
+		operand.label += label_base;
+		return true;
+	case 's':
+		operand = Operand(intern(std::string_view(text).substr(1)));
+		return true;
+	default:
+		return false;
+	}
+}
+
+CodeCache::CodeCache(std::string directory)
+    : directory(std::move(directory)) {
+	std::error_code error_code;
+	std::filesystem::create_directories(this->directory, error_code);
+	if (error_code) {
+		error("Cannot create cache directory " + this->directory + ": " +
+		      error_code.message());
+	}
+}
+
+std::string CodeCache::path(std::uint64_t key) const {
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx",
+	              static_cast<unsigned long long>(key));
+	return directory + "/" + name;
+}
+
+bool CodeCache::load(std::uint64_t                                  key,
+                     const std::function<Symbol(std::string_view)> &intern,
+                     Assembly                                      &out) const {
+	std::ifstream file(path(key));
+	if (!file) {
+		return false;
+	}
+
+	// 壊れたキャッシュは無かったことにする（out は途中まで変更しない）
+	std::string header;
+	std::getline(file, header);
+	std::size_t label_count, instruction_count;
+	if (header != cache_header || !(file >> label_count)) {
+		return false;
+	}
+	std::vector<std::string> label_names(label_count);
+	for (auto &name : label_names) {
+		if (!(file >> name)) {
+			return false;
+		}
+	}
+
+	const auto label_base = static_cast<std::uint32_t>(out.label_names.size());
+	if (!(file >> instruction_count)) {
+		return false;
+	}
+	std::vector<Instruction> instructions(instruction_count);
+	for (auto &instruction : instructions) {
+		int opcode, condition;
+		if (!(file >> opcode >> condition) ||
+		    !read_operand(file, label_base, intern, instruction.dst) ||
+		    !read_operand(file, label_base, intern, instruction.src)) {
+			return false;
+		}
+		if (opcode < 0 ||
+		    opcode > static_cast<int>(Instruction::opcode_type::function)) {
+			return false;
+		}
+		instruction.opcode    = static_cast<Instruction::opcode_type>(opcode);
+		instruction.condition = static_cast<Condition>(condition);
+	}
+
+	out.label_names.insert(out.label_names.end(),
+	                       std::make_move_iterator(label_names.begin()),
+	                       std::make_move_iterator(label_names.end()));
+	out.instructions.insert(out.instructions.end(), instructions.begin(),
+	                        instructions.end());
+	return true;
+}
+
+void CodeCache::store(std::uint64_t key, const Assembly &assembly) const {
+	std::ostringstream text;
+	text << cache_header << "\n" << assembly.label_names.size() << "\n";
+	for (const auto &name : assembly.label_names) {
+		text << name << "\n";
+	}
+	text << assembly.instructions.size() << "\n";
+	for (const auto &instruction : assembly.instructions) {
+		text << static_cast<int>(instruction.opcode) << ' '
+		     << static_cast<int>(instruction.condition) << ' ';
+		write_operand(text, instruction.dst);
+		text << ' ';
+		write_operand(text, instruction.src);
+		text << "\n";
+	}
+
+	// 書きかけのファイルを読まれないよう、別名で書いてから置き換える
+	const auto destination = path(key);
+	std::ostringstream temporary;
+	temporary << destination << ".tmp." << getpid() << "."
+	          << std::this_thread::get_id();
+	// キャッシュに書けなくてもコンパイルは続ける
+	std::error_code error_code;
+	{
+		std::ofstream file(temporary.str());
+		if (file << text.str() && file.flush()) {
+			file.close();
+			std::filesystem::rename(temporary.str(), destination, error_code);
+			if (!error_code) {
+				return;
+			}
+		}
+	}
+	std::filesystem::remove(temporary.str(), error_code);
+}
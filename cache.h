@@ -0,0 +1,43 @@
+#ifndef INCLUDE_GUARD_CACHE_
+#define INCLUDE_GUARD_CACHE_
+
+#include "assembly.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/**
+ * hash of a function-definition subtree (structure, names and values)
+ * seed distinguishes the code generation options, and the hash of the
+ * compiler executable distinguishes builds of the compiler
+ */
+std::uint64_t hash_function(const Node &function, std::uint64_t seed);
+
+/**
+ * on-disk cache of generated code of each function
+ * one file <directory>/<key in hex> per function
+ * (labels are named per function, so a cached function can be spliced
+ * into any translation unit)
+ */
+class CodeCache {
+private:
+	std::string directory;
+
+	std::string path(std::uint64_t key) const;
+
+public:
+	explicit CodeCache(std::string directory);
+
+	/**
+	 * append the cached code of key to out
+	 * intern gives the symbol of a function name (called from this thread)
+	 * returns false if not cached
+	 */
+	bool load(std::uint64_t key,
+	          const std::function<Symbol(std::string_view)> &intern,
+	          Assembly &out) const;
+	// can be called concurrently (even from other processes)
+	void store(std::uint64_t key, const Assembly &assembly) const;
+};
+
+#endif
@@ -1,274 +1,302 @@
 #include "codegen.h"
+#include "error.h"
+#include "fold.h"
+#include "licm.h"
+#include "strength.h"
+#include "symbol_table.h"
+#include "tailcall.h"
+#include <algorithm>
 #include <cassert>
-#include <forward_list>
-#include <iostream>
+#include <limits>
+#include <unordered_set>
 
-using namespace std::string_literals;
+namespace {
+/**
+ * 生成中の関数の状態
+ * 関数ごとに独立しているので、関数単位で並列に生成できる
+ */
+struct FunctionState {
+	Assembly     &out;
+	const Node   &function;
+	Symbol        name;
+	SymbolTable   symbol_table; // ローカル変数
+	std::uint32_t label_number; // 関数内のラベルの通し番号
+	// 末尾位置の呼び出し（フレームを畳んで jmp する）
+	std::unordered_set<const Node *> tail_calls;
+	Label recursion_label; // 自分自身の末尾呼び出しの飛び先（仮引数の格納）
+	InvariantSlots invariants; // ループの前で計算しておくループ不変式
+
+	Label new_label(std::string_view kind, std::uint32_t number) {
+		return out.new_label(name, kind, number);
+	}
+};
+} // namespace
 
-static std::forward_list<std::vector<std::string>> identifier_list;
+static void gen(const Node &node, FunctionState &state);
 
 /**
- * ブロックの追加
+ * identifier: 識別子
+ * 最も内側のスコープから identifier を検索してスタックにそのアドレスを返却する
+ * なければエラー
  */
-static void push_block() {
-	identifier_list.emplace_front();
+static void setup_identifier(Symbol identifier, FunctionState &state) {
+	auto &out = state.out;
+
+	out.mov(Register::rax, Register::rbp);
+	out.sub(Register::rax,
+	        static_cast<std::int64_t>(state.symbol_table.offset(identifier)));
+	out.push(Register::rax);
 }
 
-/**
- * ブロックの削除
- */
-static void pop_block() {
-	identifier_list.pop_front();
+// 結果をスタックに積まないノード（文）か
+static bool is_statement(const Node &node) {
+	switch (node.type) {
+	case Node::node_type::ifelse_:
+	case Node::node_type::if_:
+	case Node::node_type::for_:
+	case Node::node_type::while_:
+	case Node::node_type::statements:
+	case Node::node_type::empty:
+	case Node::node_type::return_:
+		return true;
+	default:
+		return false;
+	}
 }
 
 /**
- * identifier: 識別子
- * identifier を 最新のブロック に所属する識別子として登録する
+ * node を文として計算する
+ * 式文なら、スタックに積まれた結果を rax に取り出す
+ * （関数の末尾なら、それが戻り値になる）
  */
-static void register_identifier(const std::string &identifier) {
-	assert(!identifier_list.empty());
-
-	// 初めての識別子
-	if (auto &front_block = identifier_list.front();
-	    std::find(front_block.begin(), front_block.end(), identifier) ==
-	    front_block.end()) {
-		front_block.push_back(identifier);
+static void gen_statement(const Node &node, FunctionState &state) {
+	gen(node, state);
+	if (!is_statement(node)) {
+		state.out.pop(Register::rax);
 	}
 }
 
+// 引数に対応するレジスタ
+static constexpr Register target_registers[] = {
+    Register::rdi, Register::rsi, Register::rdx,
+    Register::rcx, Register::r8,  Register::r9};
+
 /**
- * identifier: 識別子
- * 最新のブロックから identifier を検索してスタックにそのアドレスを返却する
- * なければエラー
+ * 条件式 condition の真偽が value なら label に飛ぶ
+ * 比較なら 0/1 を作らずに cmp と jcc にする
  */
-static void setup_identifier(const std::string &identifier) {
-	assert(!identifier_list.empty());
-
-	auto &front_block = identifier_list.front();
-	if (auto identifier_it =
-	        std::find(front_block.cbegin(), front_block.cend(), identifier);
-	    identifier_it == front_block.end()) {
-		std::cerr << "識別子が見つかりませんでした" << std::endl;
-		std::exit(EXIT_FAILURE);
-	} else {
-		std::cout << "	mov rax, rbp\n"
-		          << "	sub rax, "
-		          << (std::distance(front_block.cbegin(), identifier_it) + 1) * 8
-		          << "\n"
-		          << "	push rax\n";
+static void gen_branch(const Node &condition, bool value, Label label,
+                       FunctionState &state) {
+	auto &out = state.out;
+
+	if (const auto holds = comparison(condition);
+	    holds && !state.invariants.slot(condition)) {
+		assert(condition.child.size() == 2);
+		gen(*condition.child[0], state);
+		gen(*condition.child[1], state);
+
+		out.pop(Register::rdi);
+		out.pop(Register::rax);
+		out.cmp(Register::rax, Register::rdi);
+		out.j(value ? *holds : negate(*holds), label);
+		return;
 	}
+
+	gen(condition, state);
+	out.pop(Register::rax);
+	out.test(Register::rax, Register::rax);
+	out.j(value ? Condition::ne : Condition::e, label);
 }
 
-void gen(const Node &node) {
-	if (Node::node_type::identifier == node.type) {
-		assert(node.child.empty());
+/**
+ * ループ loop の前で、その不変式をスロットに計算する
+ * （for なら初期化式の後）
+ */
+static void gen_preheader(const Node &loop, FunctionState &state) {
+	state.invariants.gen_preheader(loop, state.out, [&](const Node &invariant) {
+		gen(invariant, state);
+		state.out.pop(Register::rax);
+		return Register::rax;
+	});
+}
 
-		setup_identifier(node.value);
-		std::cout << "	pop rax\n"
-		          << "	mov rax, [rax]\n"
-		          << "	push rax\n";
+static void gen(const Node &node, FunctionState &state) {
+	auto &out = state.out;
 
+	if (Node::node_type::empty == node.type) {
 		return;
 	}
-	if (Node::node_type::number == node.type) {
+	if (const auto slot = state.invariants.slot(node)) {
+		out.mov(Register::rax, *slot);
+		out.push(Register::rax);
+		return;
+	}
+	if (Node::node_type::identifier == node.type) {
 		assert(node.child.empty());
 
-		std::cout << "	push " << node.value << "\n";
+		setup_identifier(node.value, state);
+		out.pop(Register::rax);
+		out.mov(Register::rax, memory(Register::rax));
+		out.push(Register::rax);
 
 		return;
 	}
+	if (Node::node_type::number == node.type) {
+		assert(node.child.empty());
 
-	// 引数に対応するレジスタ
-	constexpr const char *target_registers[] = {"rdi", "rsi", "rdx",
-	                                            "rcx", "r8",  "r9"};
-
-	// function-definition
-	if (Node::node_type::function == node.type) {
-		assert(node.child.size() == 1);
-
-		std::cout << node.value << ":"
-		          << "\n";
-
-		push_block();
-
-		/* 仮引数の識別子を登録 */
-		for (const auto &dummy_argument_name : node.identifier_list) {
-			register_identifier(dummy_argument_name);
-		}
-
-		/* あるノード下の識別子の数を数えつつ、識別子の登録もする */
-		constexpr auto funcHowManyIdentifiers = [](auto &&     func,
-		                                           const Node &node) -> size_t {
-			if (Node::node_type::identifier == node.type) {
-				register_identifier(node.value);
-				return 1;
-			}
-
-			size_t howManyIdentifiers = 0;
-			for (const auto &child : node.child) {
-				howManyIdentifiers += func(func, *child);
-			}
-			return howManyIdentifiers;
-		};
-		const size_t howManyIdentifiers =
-		    funcHowManyIdentifiers(funcHowManyIdentifiers, node);
-
-		// プロローグ
-		std::cout << "	push rbp\n"
-		          << "	mov rbp, rsp\n"
-		          << "	sub rsp, " << howManyIdentifiers * 8 << "\n"; // 変数の数
-
-		/* 仮引数に実引数を代入 */
-		for (size_t i = 0; i < node.identifier_list.size(); ++i) {
-			setup_identifier(node.identifier_list[i]);
-			std::cout << "	pop rax\n"
-			          << "	mov [rax], " << target_registers[i] << "\n";
-		}
-
-		/* 関数本体の実行 */
-		for (const auto &child : node.child) {
-			gen(*child);
+		// push の即値は 32 bit まで
+		const auto value = number_value(node.value);
+		if (std::numeric_limits<std::int32_t>::min() <= value &&
+		    value <= std::numeric_limits<std::int32_t>::max()) {
+			out.push(value);
+		} else {
+			out.mov(Register::rax, value);
+			out.push(Register::rax);
 		}
 
-		// エピローグ
-		std::cout << "	mov rsp, rbp\n"
-		          << "	pop rbp\n"
-		          << "	ret\n";
-
-		pop_block();
-
 		return;
 	}
 
 	// call
 	if (Node::node_type::call == node.type) {
-		assert(node.child.size() <= 6);
+		if (node.child.size() > std::size(target_registers)) {
+			error("too many arguments to " + std::string(node.value.str()));
+		}
 
 		/* 実引数の計算（右から）*/
 		for (auto it = node.child.rbegin(), rend = node.child.rend(); rend != it;
 		     ++it) {
-			gen(**it);
+			gen(**it, state);
 		}
 
 		/* 計算した実引数をレジスタに規定のレジスタに格納（左から順に取り出すことができる）*/
 		for (size_t i = 0; i < node.child.size(); ++i) {
-			std::cout << "	pop " << target_registers[i] << "\n";
+			out.pop(target_registers[i]);
+		}
+
+		if (state.tail_calls.contains(&node)) {
+			if (is_self_tail_call(state.function, node)) {
+				// 自分自身なら、実引数を仮引数に入れ直して先頭から繰り返す
+				out.jmp(state.recursion_label);
+			} else {
+				// フレームを畳んで飛ぶ（呼び出し先は呼び出し元に直接戻る）
+				out.mov(Register::rsp, Register::rbp);
+				out.pop(Register::rbp);
+				out.jmp(node.value);
+			}
+			return;
 		}
 
 		// RSPは16の倍数になっているはずである（最初のローカル変数の確保で、16の倍数になるよう調整しているはずだから）（呼び出し規約）
 		// うーん、まずいこともあるなぁ…
-		std::cout << "	call " << node.value << "\n"
-		          << "	push rax\n";
+		out.call(node.value);
+		out.push(Register::rax);
 		return;
 	}
 
 	// if-else
 	if (Node::node_type::ifelse_ == node.type) {
-		static uint32_t label_number = 0;
-		const auto      elselabel = ".Lifelseelse"s + std::to_string(label_number);
-		const auto      endlabel  = ".Lifelseend"s + std::to_string(label_number);
+		const auto number    = state.label_number++;
+		const auto elselabel = state.new_label("ifelseelse", number);
+		const auto endlabel  = state.new_label("ifelseend", number);
 
 		assert(node.child.size() == 3);
 
-		// 条件式
-		gen(*node.child[0]);
+		// 条件式（偽なら else節 に飛ぶ）
+		gen_branch(*node.child[0], false, elselabel, state);
 
-		std::cout << "	pop rax\n"    //条件式の結果を取り出し
-		          << "	cmp rax, 0\n" // 0と比較して
-		          << "	je " << elselabel << "\n"; // 等しければ else節 に飛ぶ
-		gen(*node.child[1]);                       // 真の時実行する文
-		std::cout << "	jmp " << endlabel << "\n"; // else の後ろに飛ぶ
-		std::cout << elselabel << ":"
-		          << "\n";   // else節
-		gen(*node.child[2]); // 偽の時実行する文
-		std::cout << endlabel << ":" << std::endl;
+		gen_statement(*node.child[1], state); // 真の時実行する文
+		out.jmp(endlabel);                    // else の後ろに飛ぶ
+		out.bind(elselabel);                  // else節
+		gen_statement(*node.child[2], state); // 偽の時実行する文
+		out.bind(endlabel);
 
-		++label_number;
 		return;
 	}
 
 	// if
 	if (Node::node_type::if_ == node.type) {
-		static uint32_t label_number = 0;
-		const auto      label        = ".Lifend"s + std::to_string(label_number);
+		const auto number = state.label_number++;
+		const auto label  = state.new_label("ifend", number);
 
 		assert(node.child.size() == 2);
 
-		// 条件式
-		gen(*node.child[0]);
+		// 条件式（偽なら label に飛ぶ）
+		gen_branch(*node.child[0], false, label, state);
 
-		std::cout << "	pop rax\n"              //条件式の結果を取り出し
-		          << "	cmp rax, 0\n"           // 0と比較して
-		          << "	je " << label << "\n";  // 等しければ label に飛ぶ
-		gen(*node.child[1]);                    // 真の時実行する文
-		std::cout << label << ":" << std::endl; // 偽の時ここに飛ぶ
+		gen_statement(*node.child[1], state); // 真の時実行する文
+		out.bind(label);                      // 偽の時ここに飛ぶ
 
-		++label_number;
 		return;
 	}
 
 	// while
 	if (Node::node_type::while_ == node.type) {
-		static uint32_t label_number = 0;
-		const auto      beginlabel = ".Lwhilebegin"s + std::to_string(label_number);
-		const auto      endlabel   = ".Lwhileend"s + std::to_string(label_number);
+		const auto number     = state.label_number++;
+		const auto beginlabel = state.new_label("whilebegin", number);
+		const auto endlabel   = state.new_label("whileend", number);
 
 		assert(node.child.size() == 2);
 
-		std::cout << beginlabel << ":"
-		          << "\n";
+		gen_preheader(node, state);
 
-		// 条件式
-		gen(*node.child[0]);
-
-		std::cout << "	pop rax\n"    //条件式の結果を取り出し
-		          << "	cmp rax, 0\n" // 0と比較して
-		          << "	je " << endlabel << "\n"; // 偽なら終了
-		gen(*node.child[1]);                      // 真の時実行する文
-		std::cout << "	jmp " << beginlabel << "\n";
-		std::cout << endlabel << ":" << std::endl; // 偽の時ここに飛ぶ
+		// 条件式を先頭（1 回目）と末尾に置き、1 周あたりの分岐を 1 回にする
+		// （常に真なら判定しない）
+		const bool always = is_constant_true(*node.child[0]);
+		if (!always) {
+			gen_branch(*node.child[0], false, endlabel, state); // 偽なら終了
+		}
+		out.bind(beginlabel);
+		gen_statement(*node.child[1], state); // 真の時実行する文
+		if (always) {
+			out.jmp(beginlabel);
+		} else {
+			gen_branch(*node.child[0], true, beginlabel, state); // 真なら繰り返す
+		}
+		out.bind(endlabel); // 偽の時ここに飛ぶ
 
-		++label_number;
 		return;
 	}
 
 	// for
 	if (Node::node_type::for_ == node.type) {
-		static uint32_t label_number = 0;
-		const auto      beginlabel   = ".Lforbegin"s + std::to_string(label_number);
-		const auto      endlabel     = ".Lforend"s + std::to_string(label_number);
+		const auto number     = state.label_number++;
+		const auto beginlabel = state.new_label("forbegin", number);
+		const auto endlabel   = state.new_label("forend", number);
 
 		assert(node.child.size() == 4);
 
 		// 初期化式
-		gen(*node.child[0]);
-
-		// 繰り返し開始位置
-		std::cout << beginlabel << ":"
-		          << "\n";
+		gen_statement(*node.child[0], state);
+		gen_preheader(node, state);
 
-		// 条件式
-		gen(*node.child[1]);
+		// 条件式は while と同じく先頭と末尾に置く（常に真なら判定しない）
+		const bool always = is_constant_true(*node.child[1]);
+		if (!always) {
+			gen_branch(*node.child[1], false, endlabel, state); // 偽なら終了
+		}
 
-		std::cout << "	pop rax\n"    //条件式の結果を取り出し
-		          << "	cmp rax, 0\n" // 0と比較して
-		          << "	je " << endlabel << "\n"; // 偽なら終了
-		gen(*node.child[3]);                      // 真の時実行する文
-		gen(*node.child[2]);                      // 終了時処理
-		std::cout << "	jmp " << beginlabel << "\n";
-		std::cout << endlabel << ":" << std::endl; // 偽の時ここに飛ぶ
+		// 繰り返し開始位置
+		out.bind(beginlabel);
+		gen_statement(*node.child[3], state); // 真の時実行する文
+		gen_statement(*node.child[2], state); // 終了時処理
+		if (always) {
+			out.jmp(beginlabel);
+		} else {
+			gen_branch(*node.child[1], true, beginlabel, state); // 真なら繰り返す
+		}
+		out.bind(endlabel); // 偽の時ここに飛ぶ
 
-		++label_number;
 		return;
 	}
 
 	// return
 	if (Node::node_type::return_ == node.type) {
-		gen(*node.child[0]);
-		std::cout << "	pop rax\n"
-		          << "	mov rsp, rbp\n"
-		          << "	pop rbp\n"
-		          << "	ret\n";
+		gen(*node.child[0], state);
+		out.pop(Register::rax);
+		out.mov(Register::rsp, Register::rbp);
+		out.pop(Register::rbp);
+		out.ret();
 		return;
 	}
 
@@ -277,13 +305,13 @@ void gen(const Node &node) {
 		assert(node.child.size() == 2);
 		assert(node.child[0]->type == Node::node_type::identifier);
 
-		setup_identifier(node.child[0]->value);
-		gen(*node.child[1]);
+		setup_identifier(node.child[0]->value, state);
+		gen(*node.child[1], state);
 
-		std::cout << "	pop rdi\n"
-		          << "	pop rax\n"
-		          << "	mov [rax], rdi\n"
-		          << "	push rdi\n";
+		out.pop(Register::rdi);
+		out.pop(Register::rax);
+		out.mov(memory(Register::rax), Register::rdi);
+		out.push(Register::rdi);
 		return;
 	}
 
@@ -291,16 +319,16 @@ void gen(const Node &node) {
 	if (Node::node_type::plus == node.type ||
 	    Node::node_type::minus == node.type) {
 		assert(node.child.size() == 1);
-		gen(*node.child[0]);
+		gen(*node.child[0], state);
 
-		std::cout << "	pop rax\n";
+		out.pop(Register::rax);
 		switch (node.type) {
 		case Node::node_type::plus:
-			std::cout << "	push rax\n";
+			out.push(Register::rax);
 			break;
 		case Node::node_type::minus:
-			std::cout << "	neg rax\n";
-			std::cout << "	push rax\n";
+			out.neg(Register::rax);
+			out.push(Register::rax);
 			break;
 		default:
 			assert(false);
@@ -313,7 +341,7 @@ void gen(const Node &node) {
 		assert(node.child.size() == 1);
 		assert(node.child[0]->type == Node::node_type::identifier);
 
-		setup_identifier(node.child[0]->value);
+		setup_identifier(node.child[0]->value, state);
 		return;
 	}
 
@@ -321,10 +349,31 @@ void gen(const Node &node) {
 	if (Node::node_type::indirection == node.type) {
 		assert(node.child.size() == 1);
 
-		gen(*node.child[0]);              // スタックにアドレスがある
-		std::cout << "	pop rax\n"        // rax にアドレスを読み出して
-		          << "	mov rax, [rax]\n" // rax にそのアドレスの値を書いて
-		          << "	push rax\n";      // rax の値をスタックに積む
+		gen(*node.child[0], state);   // スタックにアドレスがある
+		out.pop(Register::rax); // rax にアドレスを読み出して
+		out.mov(Register::rax,
+		        memory(Register::rax)); // rax にそのアドレスの値を書いて
+		out.push(Register::rax);        // rax の値をスタックに積む
+		return;
+	}
+
+	// multiplication and division by constant
+	if (const auto constant = constant_operand(node)) {
+		gen(*node.child[constant == node.child[0] ? 1 : 0], state);
+		out.pop(Register::rax);
+
+		const auto value = number_value(constant->value);
+		if (Node::node_type::multiplication == node.type) {
+			if (!gen_multiply_constant(out, Register::rax, Register::rdi, value)) {
+				out.mov(Register::rdi, value);
+				out.imul(Register::rax, Register::rdi);
+			}
+		} else if (!gen_divide_constant(out, value, Register::rdi)) {
+			out.mov(Register::rdi, value);
+			out.cqo();
+			out.idiv(Register::rdi);
+		}
+		out.push(Register::rax);
 		return;
 	}
 
@@ -340,74 +389,126 @@ void gen(const Node &node) {
 	    Node::node_type::multiplication == node.type ||
 	    Node::node_type::division == node.type) {
 		assert(node.child.size() == 2);
-		gen(*node.child[0]);
-		gen(*node.child[1]);
+		gen(*node.child[0], state);
+		gen(*node.child[1], state);
 
-		std::cout << "	pop rdi\n";
-		std::cout << "	pop rax\n";
+		out.pop(Register::rdi);
+		out.pop(Register::rax);
 
 		switch (node.type) {
 		case Node::node_type::equal:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	sete al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::e, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::not_equal:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	setne al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::ne, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::greater_equal:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	setge al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::ge, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::less_equal:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	setle al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::le, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::greater:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	setg al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::g, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::less:
-			std::cout << "	cmp rax, rdi\n";
-			std::cout << "	setl al\n";
-			std::cout << "	movzb rax, al\n";
+			out.cmp(Register::rax, Register::rdi);
+			out.set(Condition::l, byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
 			break;
 		case Node::node_type::addition:
-			std::cout << "	add rax, rdi\n";
+			out.add(Register::rax, Register::rdi);
 			break;
 		case Node::node_type::subtraction:
-			std::cout << "	sub rax, rdi\n";
+			out.sub(Register::rax, Register::rdi);
 			break;
 		case Node::node_type::multiplication:
-			std::cout << "	imul rax, rdi\n";
+			out.imul(Register::rax, Register::rdi);
 			break;
 		case Node::node_type::division:
-			std::cout << "	cqo\n";
-			std::cout << "	idiv rdi\n";
+			out.cqo();
+			out.idiv(Register::rdi);
 			break;
 		default:
 			assert(false);
 		}
-		std::cout << "	push rax\n";
+		out.push(Register::rax);
 		return;
 	}
 
 	// statements
 	if (Node::node_type::statements == node.type) {
+		state.symbol_table.enter_block(node);
 		for (const auto &child : node.child) {
-			gen(*child); // 結果はスタックに入っているので
-			std::cout
-			    << "	pop rax\n"; // 必要かどうかは分からないが rax に取り出して置く
+			gen_statement(*child, state);
 		}
+		state.symbol_table.leave_block();
 		return;
 	}
 
-	std::cerr << "not implemented type(" << static_cast<int>(node.type)
-	          << ") on codegen" << std::endl;
-	std::exit(EXIT_FAILURE);
+	error("not implemented type(" + std::to_string(static_cast<int>(node.type)) +
+	      ") on codegen");
+}
+
+void gen_function(const Node &node, Assembly &out) {
+	assert(Node::node_type::function == node.type);
+	assert(node.child.size() == 1);
+	if (node.parameters().size() > std::size(target_registers)) {
+		error("too many parameters of " + std::string(node.value.str()));
+	}
+
+	out.function(node.value);
+
+	/* 仮引数とローカル変数の登録 */
+	FunctionState state{out,
+	                    node,
+	                    node.value,
+	                    SymbolTable(node),
+	                    0,
+	                    find_tail_calls(node),
+	                    {},
+	                    {}};
+	state.recursion_label = state.new_label("recursion", 0);
+	const bool recursive  = std::any_of(
+	    state.tail_calls.begin(), state.tail_calls.end(),
+	    [&](const Node *call) { return is_self_tail_call(node, *call); });
+
+	// ループ不変式は変数の後ろのスロットに置く
+	state.invariants = InvariantSlots(node, state.symbol_table.frame_slots());
+
+	// プロローグ
+	out.push(Register::rbp);
+	out.mov(Register::rbp, Register::rsp);
+	out.sub(Register::rsp,
+	        static_cast<std::int64_t>((state.symbol_table.frame_slots() +
+	                                   state.invariants.count()) *
+	                                  8)); // 変数とループ不変式の数
+
+	/* 仮引数に実引数を代入 */
+	if (recursive) {
+		out.bind(state.recursion_label);
+	}
+	for (size_t i = 0; i < node.parameters().size(); ++i) {
+		setup_identifier(node.parameters()[i], state);
+		out.pop(Register::rax);
+		out.mov(memory(Register::rax), target_registers[i]);
+	}
+
+	/* 関数本体の実行 */
+	gen(*node.child[0], state);
+
+	// エピローグ
+	out.mov(Register::rsp, Register::rbp);
+	out.pop(Register::rbp);
+	out.ret();
 }
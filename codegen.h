@@ -1,10 +1,12 @@
 #ifndef INCLUDE_GUARD_CODEGEN_
 #define INCLUDE_GUARD_CODEGEN_
 
+#include "assembly.h"
 #include "parser.h"
 #include <memory>
 
-// calculate node and "push" result to stack
-void gen(const Node &node);
+// generate function definition, "push"-ing every intermediate result to stack
+// (functions share no state, so they can be generated concurrently)
+void gen_function(const Node &function, Assembly &out);
 
 #endif
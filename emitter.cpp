@@ -0,0 +1,27 @@
+#include "emitter.h"
+#include "error.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+void Emitter::flush() {
+	if (fd == no_file) {
+		return;
+	}
+
+	std::string_view rest = buffer;
+	while (!rest.empty()) {
+		const auto written = ::write(fd, rest.data(), rest.size());
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error("Failed to write assembly: "s + std::strerror(errno));
+		}
+		rest.remove_prefix(written);
+	}
+	written += buffer.size();
+	buffer.clear();
+}
@@ -0,0 +1,82 @@
+#ifndef INCLUDE_GUARD_EMITTER_
+#define INCLUDE_GUARD_EMITTER_
+
+#include "ast.h"
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * buffered assembly output
+ * text is accumulated in a large in-memory buffer and written to the file
+ * descriptor with a few write(2) calls (nothing is flushed per line).
+ * without a file descriptor, the text just stays in the buffer.
+ */
+class Emitter {
+private:
+	static constexpr std::size_t flush_threshold = 1 << 20;
+	static constexpr int         no_file         = -1;
+
+	std::string buffer;
+	int         fd;
+	std::size_t written = 0; // bytes already written to fd
+
+public:
+	Emitter()
+	    : fd(no_file) {}
+	explicit Emitter(int fd)
+	    : fd(fd) {
+		buffer.reserve(flush_threshold + flush_threshold / 4);
+	}
+	Emitter(const Emitter &) = delete;
+	Emitter &operator=(const Emitter &) = delete;
+	~Emitter() {
+		flush();
+	}
+
+	Emitter &operator<<(std::string_view text) {
+		buffer.append(text);
+		if (fd != no_file && buffer.size() >= flush_threshold) {
+			flush();
+		}
+		return *this;
+	}
+	Emitter &operator<<(const char *text) {
+		return *this << std::string_view(text);
+	}
+	Emitter &operator<<(const std::string &text) {
+		return *this << std::string_view(text);
+	}
+	Emitter &operator<<(char c) {
+		buffer.push_back(c);
+		return *this;
+	}
+	Emitter &operator<<(Symbol symbol) {
+		return *this << symbol.str();
+	}
+	template <std::integral T>
+	Emitter &operator<<(T value) {
+		char digits[24];
+		auto [last, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+		return *this << std::string_view(digits, last - digits);
+	}
+
+	// text buffered so far (not yet written)
+	std::string_view str() const {
+		return buffer;
+	}
+	void clear() {
+		buffer.clear();
+	}
+	// bytes emitted in total (written and buffered)
+	std::size_t size() const {
+		return written + buffer.size();
+	}
+
+	// write out the buffer to the file descriptor
+	void flush();
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include "encoder.h"
+#include <cassert>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+using opcode_type = Instruction::opcode_type;
+using kind_type   = Operand::kind_type;
+
+// rel32 to be patched after all labels and functions are placed
+struct LabelFixup {
+	std::size_t   offset; // offset of the rel32 field
+	std::uint32_t label;
+};
+struct CallFixup {
+	std::size_t offset; // offset of the rel32 field
+	Symbol      function;
+};
+
+class Encoder {
+private:
+	MachineCode             &code;
+	std::vector<std::size_t> label_offsets;
+	std::vector<LabelFixup>  label_fixups;
+	std::vector<CallFixup>   call_fixups;
+
+	static constexpr std::size_t unbound =
+	    std::numeric_limits<std::size_t>::max();
+
+	static std::uint8_t number(Register reg) {
+		return static_cast<std::uint8_t>(reg);
+	}
+	static bool fits_int8(std::int64_t value) {
+		return std::numeric_limits<std::int8_t>::min() <= value &&
+		       value <= std::numeric_limits<std::int8_t>::max();
+	}
+	static bool fits_int32(std::int64_t value) {
+		return std::numeric_limits<std::int32_t>::min() <= value &&
+		       value <= std::numeric_limits<std::int32_t>::max();
+	}
+
+	void byte(std::uint8_t value) {
+		code.text.push_back(value);
+	}
+	void int32(std::int64_t value) {
+		assert(fits_int32(value));
+		for (int i = 0; i < 4; ++i) {
+			byte(static_cast<std::uint8_t>(value >> (i * 8)));
+		}
+	}
+	void int64(std::int64_t value) {
+		for (int i = 0; i < 8; ++i) {
+			byte(static_cast<std::uint8_t>(value >> (i * 8)));
+		}
+	}
+
+	// REX prefix (W: 64 bit operand, R: extension of ModRM.reg, B: of rm/base)
+	void rex(bool w, std::uint8_t reg, std::uint8_t rm, bool force = false) {
+		const std::uint8_t prefix =
+		    0x40 | (w ? 0x08 : 0) | (reg & 8 ? 0x04 : 0) | (rm & 8 ? 0x01 : 0);
+		if (prefix != 0x40 || force) {
+			byte(prefix);
+		}
+	}
+
+	/**
+	 * ModRM (and SIB, displacement) for reg field and register/memory operand
+	 * rm is emitted without its REX extension bit (see rex)
+	 */
+	void modrm(std::uint8_t reg, const Operand &rm) {
+		const auto base = number(rm.base);
+		if (kind_type::reg == rm.kind || kind_type::reg8 == rm.kind) {
+			byte(0xC0 | (reg & 7) << 3 | (base & 7));
+			return;
+		}
+		assert(kind_type::mem == rm.kind);
+
+		// [rbp], [r13] は mod=00 で表せない（RIP 相対などになる）
+		std::uint8_t mod;
+		if (rm.disp == 0 && (base & 7) != 5) {
+			mod = 0x00;
+		} else if (fits_int8(rm.disp)) {
+			mod = 0x40;
+		} else {
+			mod = 0x80;
+		}
+		byte(mod | (reg & 7) << 3 | (base & 7));
+		// [rsp], [r12] は SIB が必要
+		if ((base & 7) == 4) {
+			byte(0x24);
+		}
+		if (mod == 0x40) {
+			byte(static_cast<std::uint8_t>(rm.disp));
+		} else if (mod == 0x80) {
+			int32(rm.disp);
+		}
+	}
+
+	// REX.W opcode /r
+	void rm64(std::initializer_list<std::uint8_t> opcode, std::uint8_t reg,
+	          const Operand &rm) {
+		rex(true, reg, number(rm.base));
+		for (const auto value : opcode) {
+			byte(value);
+		}
+		modrm(reg, rm);
+	}
+
+	void rel32_to(Label label) {
+		label_fixups.push_back(LabelFixup{code.text.size(), label.id});
+		int32(0);
+	}
+
+	// add, sub, cmp
+	void arithmetic(const Instruction &instruction, std::uint8_t reg_opcode,
+	                std::uint8_t extension) {
+		const auto &dst = instruction.dst;
+		const auto &src = instruction.src;
+		if (kind_type::imm == src.kind) {
+			if (fits_int8(src.imm)) {
+				rm64({0x83}, extension, dst);
+				byte(static_cast<std::uint8_t>(src.imm));
+			} else {
+				rm64({0x81}, extension, dst);
+				int32(src.imm);
+			}
+			return;
+		}
+		assert(kind_type::reg == src.kind);
+		rm64({reg_opcode}, number(src.base), dst);
+	}
+
+	void mov(const Instruction &instruction) {
+		const auto &dst = instruction.dst;
+		const auto &src = instruction.src;
+		switch (src.kind) {
+		case kind_type::reg:
+			rm64({0x89}, number(src.base), dst);
+			return;
+		case kind_type::mem:
+			assert(kind_type::reg == dst.kind);
+			rm64({0x8B}, number(dst.base), src);
+			return;
+		case kind_type::imm:
+			if (fits_int32(src.imm)) {
+				rm64({0xC7}, 0, dst);
+				int32(src.imm);
+			} else {
+				// movabs
+				assert(kind_type::reg == dst.kind);
+				rex(true, 0, number(dst.base));
+				byte(0xB8 + (number(dst.base) & 7));
+				int64(src.imm);
+			}
+			return;
+		default:
+			assert(false);
+		}
+	}
+
+	// push, pop
+	void stack(const Instruction &instruction, std::uint8_t opcode) {
+		const auto &operand = instruction.dst;
+		if (kind_type::imm == operand.kind) {
+			assert(opcode_type::push == instruction.opcode);
+			if (fits_int8(operand.imm)) {
+				byte(0x6A);
+				byte(static_cast<std::uint8_t>(operand.imm));
+			} else {
+				byte(0x68);
+				int32(operand.imm);
+			}
+			return;
+		}
+		assert(kind_type::reg == operand.kind);
+		rex(false, 0, number(operand.base));
+		byte(opcode + (number(operand.base) & 7));
+	}
+
+	// shl, sar, shr by imm8
+	void shift(const Instruction &instruction, std::uint8_t extension) {
+		assert(kind_type::imm == instruction.src.kind);
+		assert(0 < instruction.src.imm && instruction.src.imm < 64);
+		rm64({0xC1}, extension, instruction.dst);
+		byte(static_cast<std::uint8_t>(instruction.src.imm));
+	}
+
+	void set(const Instruction &instruction) {
+		const auto &dst = instruction.dst;
+		assert(kind_type::reg8 == dst.kind);
+		// spl, bpl, sil, dil は REX が無いと ah, ch, dh, bh になる
+		rex(false, 0, number(dst.base), number(dst.base) >= 4);
+		byte(0x0F);
+		byte(0x90 + static_cast<std::uint8_t>(instruction.condition));
+		modrm(0, dst);
+	}
+
+	void patch_rel32(std::size_t offset, std::size_t target) {
+		const auto relative = static_cast<std::int64_t>(target) -
+		                      static_cast<std::int64_t>(offset + 4);
+		assert(fits_int32(relative));
+		for (int i = 0; i < 4; ++i) {
+			code.text[offset + i] = static_cast<std::uint8_t>(relative >> (i * 8));
+		}
+	}
+
+public:
+	Encoder(MachineCode &code, std::size_t label_count)
+	    : code(code)
+	    , label_offsets(label_count, unbound) {}
+
+	void encode(const std::vector<Instruction> &instructions) {
+		for (const auto &instruction : instructions) {
+			switch (instruction.opcode) {
+			case opcode_type::mov:
+				mov(instruction);
+				break;
+			case opcode_type::movzx:
+				assert(kind_type::reg8 == instruction.src.kind);
+				rm64({0x0F, 0xB6}, number(instruction.dst.base), instruction.src);
+				break;
+			case opcode_type::lea:
+				rm64({0x8D}, number(instruction.dst.base), instruction.src);
+				break;
+			case opcode_type::push:
+				stack(instruction, 0x50);
+				break;
+			case opcode_type::pop:
+				stack(instruction, 0x58);
+				break;
+			case opcode_type::add:
+				arithmetic(instruction, 0x01, 0);
+				break;
+			case opcode_type::sub:
+				arithmetic(instruction, 0x29, 5);
+				break;
+			case opcode_type::cmp:
+				arithmetic(instruction, 0x39, 7);
+				break;
+			case opcode_type::test:
+				assert(kind_type::reg == instruction.src.kind);
+				rm64({0x85}, number(instruction.src.base), instruction.dst);
+				break;
+			case opcode_type::imul:
+				rm64({0x0F, 0xAF}, number(instruction.dst.base), instruction.src);
+				break;
+			case opcode_type::imul_high:
+				rm64({0xF7}, 5, instruction.dst);
+				break;
+			case opcode_type::idiv:
+				rm64({0xF7}, 7, instruction.dst);
+				break;
+			case opcode_type::neg:
+				rm64({0xF7}, 3, instruction.dst);
+				break;
+			case opcode_type::shl:
+				shift(instruction, 4);
+				break;
+			case opcode_type::sar:
+				shift(instruction, 7);
+				break;
+			case opcode_type::shr:
+				shift(instruction, 5);
+				break;
+			case opcode_type::cqo:
+				byte(0x48);
+				byte(0x99);
+				break;
+			case opcode_type::set:
+				set(instruction);
+				break;
+			case opcode_type::jmp:
+				byte(0xE9);
+				if (kind_type::symbol == instruction.dst.kind) {
+					// 末尾呼び出しは call と同じく関数の位置かリンカで埋める
+					call_fixups.push_back(
+					    CallFixup{code.text.size(), instruction.dst.symbol});
+					int32(0);
+				} else {
+					rel32_to(Label{instruction.dst.label});
+				}
+				break;
+			case opcode_type::jcc:
+				byte(0x0F);
+				byte(0x80 + static_cast<std::uint8_t>(instruction.condition));
+				rel32_to(Label{instruction.dst.label});
+				break;
+			case opcode_type::call:
+				byte(0xE8);
+				call_fixups.push_back(
+				    CallFixup{code.text.size(), instruction.dst.symbol});
+				int32(0);
+				break;
+			case opcode_type::ret:
+				byte(0xC3);
+				break;
+			case opcode_type::label:
+				label_offsets[instruction.dst.label] = code.text.size();
+				break;
+			case opcode_type::function:
+				if (!code.functions.empty()) {
+					auto &last = code.functions.back();
+					last.size  = code.text.size() - last.offset;
+				}
+				code.functions.push_back(MachineCode::Function{
+				    instruction.dst.symbol, code.text.size(), 0});
+				break;
+			}
+		}
+		if (!code.functions.empty()) {
+			auto &last = code.functions.back();
+			last.size  = code.text.size() - last.offset;
+		}
+
+		// ラベルと関数の位置が決まったので、飛び先を埋める
+		for (const auto &fixup : label_fixups) {
+			assert(label_offsets[fixup.label] != unbound);
+			patch_rel32(fixup.offset, label_offsets[fixup.label]);
+		}
+		std::unordered_map<Symbol, std::size_t> defined;
+		for (const auto &function : code.functions) {
+			defined.emplace(function.name, function.offset);
+		}
+		for (const auto &fixup : call_fixups) {
+			if (auto found = defined.find(fixup.function); found != defined.end()) {
+				patch_rel32(fixup.offset, found->second);
+			} else {
+				// この翻訳単位に無い関数はリンカに任せる
+				code.relocations.push_back(
+				    MachineCode::Relocation{fixup.offset, fixup.function, -4});
+			}
+		}
+	}
+};
+} // namespace
+
+MachineCode encode(const Assembly &assembly) {
+	MachineCode code;
+	Encoder(code, assembly.label_names.size()).encode(assembly.instructions);
+	return code;
+}
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_GUARD_ENCODER_
+#define INCLUDE_GUARD_ENCODER_
+
+#include "assembly.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * x86-64 machine code of a translation unit
+ * local labels and calls between functions defined here are already resolved;
+ * calls to the other functions are left as relocations
+ */
+struct MachineCode {
+	struct Function {
+		Symbol      name;
+		std::size_t offset; // offset in text
+		std::size_t size;
+	};
+	struct Relocation {
+		std::size_t  offset; // offset of the rel32 field in text
+		Symbol       symbol; // called function
+		std::int64_t addend;
+	};
+
+	std::vector<std::uint8_t> text;
+	std::vector<Function>     functions;
+	std::vector<Relocation>   relocations;
+};
+
+// encode instructions to machine code (without an external assembler)
+MachineCode encode(const Assembly &assembly);
+
+#endif
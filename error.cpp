@@ -1,14 +1,22 @@
 #include "error.h"
-#include <iostream>
+#include <cstring>
+#include <sstream>
 
 void error(std::string_view message) {
-	std::cerr << message << std::endl;
-	std::exit(EXIT_FAILURE);
+	throw CompileError(std::string(message));
 }
 void error(std::string_view message, std::string_view line,
            std::size_t line_num, std::size_t pos) {
-	std::cerr << line << "\n";
-	std::cerr << std::string(pos, ' ') << "^ ";
-	std::cerr << message << " (at line " << line_num + 1 << ")" << std::endl;
-	std::exit(EXIT_FAILURE);
+	std::ostringstream text;
+	text << line << "\n";
+	text << std::string(pos, ' ') << "^ ";
+	text << message << " (at line " << line_num + 1 << ")";
+	throw CompileError(text.str());
+}
+void error(std::string_view message, const Token &token, std::size_t offset) {
+	// token.value is a view of the NUL terminated source text,
+	// so the line starts pos bytes before it and ends at LF or NUL
+	const char *line_begin = token.value.data() - token.pos;
+	error(message, std::string_view(line_begin, std::strcspn(line_begin, "\n")),
+	      token.line_num, token.pos + offset);
 }
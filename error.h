@@ -1,10 +1,29 @@
+#ifndef INCLUDE_GUARD_ERROR_
+#define INCLUDE_GUARD_ERROR_
+
+#include "tokenizer.h"
+#include <stdexcept>
 #include <string>
 
-// print error message
-void error(std::string_view message);
+// thrown by error() (what() is the whole message to print)
+class CompileError : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+// throw error message
+[[noreturn]] void error(std::string_view message);
 
-// print error message and error line
+// throw error message and error line
 // line_num will indicate error line index
 // pos will indicate error position
-void error(std::string_view message, std::string_view line,
-           std::size_t line_num, std::size_t pos);
+[[noreturn]] void error(std::string_view message, std::string_view line,
+                        std::size_t line_num, std::size_t pos);
+
+// throw error message and the line with token
+// the line is rebuilt from the source text only here
+// offset will be added to the token position
+[[noreturn]] void error(std::string_view message, const Token &token,
+                        std::size_t offset = 0);
+
+#endif
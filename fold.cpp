@@ -0,0 +1,251 @@
+#include "fold.h"
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+/**
+ * node が数値リテラルなら、その値を返す
+ * push の即値（符号付き 32bit）に収まらない値は定数として扱わない
+ */
+static std::optional<std::int64_t> constant_value(const Node &node) {
+	if (Node::node_type::number != node.type) {
+		return std::nullopt;
+	}
+
+	std::int64_t value;
+	const auto   text  = node.value.str();
+	const auto   first = text.data();
+	const auto   last  = text.data() + text.size();
+	if (auto [ptr, ec] = std::from_chars(first, last, value);
+	    ec != std::errc() || ptr != last ||
+	    value < std::numeric_limits<std::int32_t>::min() ||
+	    value > std::numeric_limits<std::int32_t>::max()) {
+		return std::nullopt;
+	}
+
+	return value;
+}
+
+/**
+ * node を値 value の数値リテラルに置き換える
+ * 値が即値に収まらなければ何もせず false を返す
+ */
+static bool replace_with_number(SyntaxTree &tree, Node *&node,
+                                std::int64_t value) {
+	if (value < std::numeric_limits<std::int32_t>::min() ||
+	    value > std::numeric_limits<std::int32_t>::max()) {
+		return false;
+	}
+
+	node = tree.new_node(Node::node_type::number,
+	                     tree.intern(std::to_string(value)));
+	return true;
+}
+
+// 代入や関数呼び出しを含むか
+static bool has_side_effects(const Node &node) {
+	if (Node::node_type::assign == node.type ||
+	    Node::node_type::call == node.type) {
+		return true;
+	}
+
+	for (const auto &child : node.child) {
+		if (has_side_effects(*child)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * 二項演算子を定数同士で計算する
+ * 計算できない（0 除算）なら nullopt
+ */
+static std::optional<std::int64_t>
+calculate(Node::node_type type, std::int64_t lhs, std::int64_t rhs) {
+	// オペランドは 32bit に収まるので、64bit の計算は溢れない
+	switch (type) {
+	case Node::node_type::equal:
+		return lhs == rhs;
+	case Node::node_type::not_equal:
+		return lhs != rhs;
+	case Node::node_type::greater_equal:
+		return lhs >= rhs;
+	case Node::node_type::less_equal:
+		return lhs <= rhs;
+	case Node::node_type::greater:
+		return lhs > rhs;
+	case Node::node_type::less:
+		return lhs < rhs;
+	case Node::node_type::addition:
+		return lhs + rhs;
+	case Node::node_type::subtraction:
+		return lhs - rhs;
+	case Node::node_type::multiplication:
+		return lhs * rhs;
+	case Node::node_type::division:
+		if (rhs == 0) {
+			return std::nullopt; // 実行時の例外に任せる
+		}
+		return lhs / rhs; // idiv と同じく 0 方向への切り捨て
+	default:
+		assert(false);
+		return std::nullopt;
+	}
+}
+
+/**
+ * 二項演算子の恒等式による簡約
+ * x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1 => x
+ * x * 0, 0 * x => 0 (x に副作用がない時)
+ */
+static void simplify_identity(SyntaxTree &tree, Node *&node) {
+	const auto lhs = constant_value(*node->child[0]);
+	const auto rhs = constant_value(*node->child[1]);
+
+	switch (node->type) {
+	case Node::node_type::addition:
+		if (lhs == 0) {
+			node = node->child[1];
+		} else if (rhs == 0) {
+			node = node->child[0];
+		}
+		return;
+	case Node::node_type::subtraction:
+		if (rhs == 0) {
+			node = node->child[0];
+		}
+		return;
+	case Node::node_type::multiplication:
+		if (lhs == 1) {
+			node = node->child[1];
+		} else if (rhs == 1) {
+			node = node->child[0];
+		} else if ((lhs == 0 && !has_side_effects(*node->child[1])) ||
+		           (rhs == 0 && !has_side_effects(*node->child[0]))) {
+			replace_with_number(tree, node, 0);
+		}
+		return;
+	case Node::node_type::division:
+		if (rhs == 1) {
+			node = node->child[0];
+		}
+		return;
+	default:
+		return;
+	}
+}
+
+// 条件式が定数なら、その真偽を返す
+static std::optional<bool> constant_condition(const Node &node) {
+	if (const auto value = constant_value(node)) {
+		return *value != 0;
+	}
+	return std::nullopt;
+}
+
+static void replace_with_empty(SyntaxTree &tree, Node *&node) {
+	node = tree.new_node(Node::node_type::empty);
+}
+
+static void fold(SyntaxTree &tree, Node *&node) {
+	for (auto &child : node->child) {
+		fold(tree, child);
+	}
+
+	switch (node->type) {
+	case Node::node_type::plus:
+		// 単項 + は何もしない
+		assert(node->child.size() == 1);
+		node = node->child[0];
+		return;
+
+	case Node::node_type::minus:
+		assert(node->child.size() == 1);
+		if (const auto value = constant_value(*node->child[0])) {
+			replace_with_number(tree, node, -*value);
+		} else if (Node::node_type::minus == node->child[0]->type) {
+			// - - x => x
+			node = node->child[0]->child[0];
+		}
+		return;
+
+	case Node::node_type::equal:
+	case Node::node_type::not_equal:
+	case Node::node_type::greater_equal:
+	case Node::node_type::less_equal:
+	case Node::node_type::greater:
+	case Node::node_type::less:
+	case Node::node_type::addition:
+	case Node::node_type::subtraction:
+	case Node::node_type::multiplication:
+	case Node::node_type::division: {
+		assert(node->child.size() == 2);
+		const auto lhs = constant_value(*node->child[0]);
+		const auto rhs = constant_value(*node->child[1]);
+		if (lhs && rhs) {
+			if (const auto value = calculate(node->type, *lhs, *rhs);
+			    value && replace_with_number(tree, node, *value)) {
+				return;
+			}
+		}
+		simplify_identity(tree, node);
+		return;
+	}
+
+	case Node::node_type::if_:
+		assert(node->child.size() == 2);
+		if (const auto condition = constant_condition(*node->child[0])) {
+			if (*condition) {
+				node = node->child[1];
+			} else {
+				replace_with_empty(tree, node);
+			}
+		}
+		return;
+
+	case Node::node_type::ifelse_:
+		assert(node->child.size() == 3);
+		if (const auto condition = constant_condition(*node->child[0])) {
+			node = node->child[*condition ? 1 : 2];
+		}
+		return;
+
+	case Node::node_type::while_:
+		assert(node->child.size() == 2);
+		if (constant_condition(*node->child[0]) == false) {
+			replace_with_empty(tree, node);
+		}
+		return;
+
+	case Node::node_type::for_:
+		assert(node->child.size() == 4);
+
+		// 結果を使わない初期化式と変化式は、副作用がなければ不要
+		for (const auto index : {0, 2}) {
+			if (!has_side_effects(*node->child[index])) {
+				replace_with_empty(tree, node->child[index]);
+			}
+		}
+
+		// 一度も実行されないなら初期化式だけ残る
+		if (constant_condition(*node->child[1]) == false) {
+			node = node->child[0];
+		}
+		return;
+
+	default:
+		return;
+	}
+}
+
+void fold_constants(SyntaxTree &tree) {
+	fold(tree, tree.root);
+}
+
+bool is_constant_true(const Node &node) {
+	return Node::node_type::number == node.type &&
+	       node.value.str().find_first_not_of('0') != std::string_view::npos;
+}
@@ -0,0 +1,13 @@
+#ifndef INCLUDE_GUARD_FOLD_
+#define INCLUDE_GUARD_FOLD_
+
+#include "ast.h"
+
+// fold constant expressions and simplify algebraic identities in place
+// (runs between Parser::makeAST() and gen())
+void fold_constants(SyntaxTree &tree);
+
+// number node other than 0 (a condition that is always true)
+bool is_constant_true(const Node &node);
+
+#endif
@@ -0,0 +1,382 @@
+#include "inline.h"
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+// 展開できる関数
+struct Candidate {
+	const Node *function;
+	const Node *value;      // 戻り値の式（本体の最後の return か式文）
+	bool        expression; // 本体が代入の無い式 value だけ
+};
+
+// 識別子を置き換える式（仮引数 => 実引数など）
+struct Replacement {
+	const Node *first; // 最初に評価される所
+	const Node *rest;  // 2 回目以降
+};
+using Substitution = std::unordered_map<Symbol, Replacement>;
+} // namespace
+
+// node と、その子孫の全てのノードに f を適用する
+template <typename Function>
+static void for_each_node(const Node &node, Function f) {
+	f(node);
+	for (const auto &child : node.child) {
+		for_each_node(*child, f);
+	}
+}
+
+// node の中に pred を満たすノードが幾つあるか
+template <typename Predicate>
+static std::size_t count(const Node &node, Predicate pred) {
+	std::size_t result = 0;
+	for_each_node(node, [&](const Node &n) { result += pred(n) ? 1 : 0; });
+	return result;
+}
+
+static bool is_type(const Node &node, Node::node_type type) {
+	return count(node, [&](const Node &n) { return type == n.type; }) != 0;
+}
+
+// 式ではない文（それ以外の文は式文）
+static bool is_statement(const Node &node) {
+	switch (node.type) {
+	case Node::node_type::ifelse_:
+	case Node::node_type::if_:
+	case Node::node_type::for_:
+	case Node::node_type::while_:
+	case Node::node_type::statements:
+	case Node::node_type::empty:
+	case Node::node_type::return_:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// node の index 番目の子が文か
+static bool is_statement_child(const Node &node, std::size_t index) {
+	switch (node.type) {
+	case Node::node_type::statements:
+		return true;
+	case Node::node_type::if_:
+	case Node::node_type::ifelse_:
+	case Node::node_type::while_:
+		return index != 0;
+	case Node::node_type::for_:
+		return index == 3;
+	default:
+		return false;
+	}
+}
+
+// 展開できるなら、その形
+static std::optional<Candidate> as_candidate(const Node &function,
+                                             std::size_t budget) {
+	const auto &body = *function.child[0];
+	assert(Node::node_type::statements == body.type);
+	if (body.child.empty() || count_nodes(body) > budget ||
+	    is_type(body, Node::node_type::call) ||
+	    is_type(body, Node::node_type::address)) {
+		return std::nullopt;
+	}
+
+	// 値を返すのは最後の文だけ（途中の return は展開できない）
+	const auto &last    = *body.child.back();
+	const auto  returns = count(body, [](const Node &node) {
+		return Node::node_type::return_ == node.type;
+	});
+	const Node *value;
+	if (Node::node_type::return_ == last.type && returns == 1) {
+		value = last.child[0];
+	} else if (!is_statement(last) && returns == 0) {
+		value = &last;
+	} else {
+		return std::nullopt;
+	}
+
+	return Candidate{&function, value,
+	                 body.child.size() == 1 &&
+	                     !is_type(*value, Node::node_type::assign)};
+}
+
+/**
+ * node の複製（substitution にある識別子は、その式の複製にする）
+ * 子は左から評価されるので、複製する順が評価の順になる
+ */
+static Node *copy(SyntaxTree &tree, const Node &node,
+                  Substitution &substitution) {
+	if (Node::node_type::identifier == node.type) {
+		if (auto found = substitution.find(node.value);
+		    found != substitution.end()) {
+			auto      &replacement = found->second;
+			const auto result      = tree.copy(*replacement.first);
+			replacement.first      = replacement.rest;
+			return result;
+		}
+	}
+
+	std::vector<Node *> children;
+	for (const auto &child : node.child) {
+		children.push_back(copy(tree, *child, substitution));
+	}
+	return tree.new_node(node.type, children, node.value);
+}
+
+namespace {
+class Inliner {
+private:
+	SyntaxTree                           &tree;
+	std::unordered_map<Symbol, Candidate> candidates;
+	// 変数名を区別する番号（呼び出し元の関数ごとに数えるので、名前は
+	// その関数の本体だけで決まり、関数ごとのキャッシュのキーも変わらない）
+	std::size_t                           sites = 0;
+
+	const Candidate *find(const Node &call) const {
+		auto found = candidates.find(call.value);
+		if (found == candidates.end() ||
+		    found->second.function->parameters().size() != call.child.size()) {
+			return nullptr;
+		}
+		return &found->second;
+	}
+
+	// 展開した function の変数 name の、この展開だけの名前 function.name.site
+	// （識別子には使えない文字を含むので、呼び出し元の変数とぶつからない）
+	Node *new_variable(Symbol function, Symbol name, const std::string &site) {
+		const auto text = std::string(function.str()) + "." +
+		                  std::string(name.str()) + "." + site;
+		return tree.new_node(Node::node_type::identifier, tree.intern(text));
+	}
+
+	Node  *inline_expression(const Node &call);
+	Node  *inline_statement(Node &statement);
+	Node **find_hoistable(Node *&node, bool &blocked);
+	Node  *hoist(Node *statement);
+
+public:
+	Inliner(SyntaxTree &tree, std::size_t budget)
+	    : tree(tree) {
+		for (const auto &function : tree.root->child) {
+			if (auto candidate = as_candidate(*function, budget)) {
+				candidates.emplace(function->value, *candidate);
+			}
+		}
+	}
+
+	void visit_function(Node &function) {
+		sites = 0;
+		visit(function.child[0], true);
+	}
+
+	void visit(Node *&node, bool statement) {
+		for (std::size_t i = 0; i < node->child.size(); ++i) {
+			visit(node->child[i], is_statement_child(*node, i));
+		}
+
+		if (Node::node_type::call == node->type) {
+			if (const auto expression = inline_expression(*node)) {
+				node = expression;
+				return;
+			}
+		}
+		if (statement) {
+			if (const auto block = inline_statement(*node)) {
+				node = block;
+			} else {
+				node = hoist(node);
+			}
+		}
+	}
+};
+} // namespace
+
+/**
+ * 式だけの関数を、仮引数を実引数に置き換えて展開する
+ * 式は代入も呼び出しもしないので、実引数にも副作用が無ければ評価の順序は
+ * 変わらない
+ * 何度も使う仮引数は、最初の所で (f.x.n = 実引数) として 1 回だけ計算する
+ * （数値と変数はそのまま複製する）
+ */
+Node *Inliner::inline_expression(const Node &call) {
+	const auto candidate = find(call);
+	if (!candidate || !candidate->expression) {
+		return nullptr;
+	}
+
+	const auto   parameters = candidate->function->parameters();
+	const auto   site       = std::to_string(++sites);
+	Substitution substitution;
+	for (std::size_t i = 0; i < parameters.size(); ++i) {
+		const auto &argument = *call.child[i];
+		if (is_type(argument, Node::node_type::assign) ||
+		    is_type(argument, Node::node_type::call)) {
+			return nullptr;
+		}
+		const auto uses = count(*candidate->value, [&](const Node &node) {
+			return Node::node_type::identifier == node.type &&
+			       node.value == parameters[i];
+		});
+		if (uses <= 1 || Node::node_type::number == argument.type ||
+		    Node::node_type::identifier == argument.type) {
+			substitution.emplace(parameters[i],
+			                     Replacement{&argument, &argument});
+			continue;
+		}
+
+		const auto  variable = new_variable(call.value, parameters[i], site);
+		Node *const assign[] = {variable, call.child[i]};
+		substitution.emplace(
+		    parameters[i], Replacement{tree.new_node(Node::node_type::assign,
+		                                             assign),
+		                               variable});
+	}
+
+	return copy(tree, *candidate->value, substitution);
+}
+
+/**
+ * f(...); x = f(...); return f(...); を
+ * { 仮引数 = 実引数; ... 本体 ...; (x = | return) 値; } にする
+ * 関数の変数はこの呼び出しだけの名前にする
+ */
+Node *Inliner::inline_statement(Node &statement) {
+	Node *call = &statement;
+	if (Node::node_type::return_ == statement.type) {
+		call = statement.child[0];
+	} else if (Node::node_type::assign == statement.type &&
+	           Node::node_type::identifier == statement.child[0]->type) {
+		call = statement.child[1];
+	}
+	if (Node::node_type::call != call->type) {
+		return nullptr;
+	}
+	const auto candidate = find(*call);
+	if (!candidate) {
+		return nullptr;
+	}
+
+	const auto &function = *candidate->function;
+	const auto &body     = *function.child[0];
+	const auto  site     = std::to_string(++sites);
+
+	Substitution renames; // 変数 => 名前を変えた変数
+	const auto   rename = [&](Symbol name) {
+		if (!renames.contains(name)) {
+			const auto variable = new_variable(function.value, name, site);
+			renames.emplace(name, Replacement{variable, variable});
+		}
+	};
+	const auto parameters = function.parameters();
+	for (const auto parameter : parameters) {
+		rename(parameter);
+	}
+	for_each_node(body, [&](const Node &node) {
+		if (Node::node_type::identifier == node.type) {
+			rename(node.value);
+		}
+	});
+
+	std::vector<Node *> statements;
+	for (std::size_t i = 0; i < parameters.size(); ++i) {
+		const auto &variable = *renames.at(parameters[i]).rest;
+		Node *const assign[] = {tree.copy(variable), call->child[i]};
+		statements.push_back(tree.new_node(Node::node_type::assign, assign));
+	}
+	for (std::size_t i = 0; i + 1 < body.child.size(); ++i) {
+		statements.push_back(copy(tree, *body.child[i], renames));
+	}
+
+	Node *value = copy(tree, *candidate->value, renames);
+	if (Node::node_type::return_ == statement.type) {
+		Node *const children[] = {value};
+		value = tree.new_node(Node::node_type::return_, children);
+	} else if (Node::node_type::assign == statement.type) {
+		Node *const children[] = {statement.child[0], value};
+		value = tree.new_node(Node::node_type::assign, children);
+	}
+	statements.push_back(value);
+
+	return tree.new_node(Node::node_type::statements, statements);
+}
+
+/**
+ * node の中で評価の順に最初の、展開できる呼び出し
+ * それより前に代入や（展開できない）呼び出しがあれば blocked にする
+ */
+Node **Inliner::find_hoistable(Node *&node, bool &blocked) {
+	for (auto &child : node->child) {
+		if (const auto found = find_hoistable(child, blocked);
+		    found || blocked) {
+			return found;
+		}
+	}
+
+	if (Node::node_type::call == node->type) {
+		const auto pure = std::none_of(
+		    node->child.begin(), node->child.end(), [](const Node *argument) {
+			    return is_type(*argument, Node::node_type::assign) ||
+			           is_type(*argument, Node::node_type::call);
+		    });
+		if (find(*node) && pure) {
+			return &node;
+		}
+		blocked = true;
+	} else if (Node::node_type::assign == node->type) {
+		blocked = true;
+	}
+	return nullptr;
+}
+
+/**
+ * 式の途中の呼び出しを、文の前で f.result.n = f(...); として展開する
+ * 呼び出しより前に評価される部分にも実引数にも副作用が無く、展開した本体は
+ * 自分の変数にしか代入しないので、先に計算しても結果は同じ
+ */
+Node *Inliner::hoist(Node *statement) {
+	Node **expression; // 呼び出しを探す式
+	switch (statement->type) {
+	case Node::node_type::return_:
+	case Node::node_type::if_:
+	case Node::node_type::ifelse_:
+		expression = &statement->child[0];
+		break;
+	default:
+		if (is_statement(*statement)) {
+			return statement;
+		}
+		expression = &statement;
+		break;
+	}
+
+	std::vector<Node *> statements;
+	bool                blocked = false;
+	while (const auto call = find_hoistable(*expression, blocked)) {
+		const auto  result     = new_variable((*call)->value, tree.intern("result"),
+		                                      std::to_string(++sites));
+		Node *const assign[]   = {result, *call};
+		const auto  assignment = tree.new_node(Node::node_type::assign, assign);
+		statements.push_back(inline_statement(*assignment));
+		*call = tree.copy(*result);
+	}
+	if (statements.empty()) {
+		return statement;
+	}
+	statements.push_back(statement);
+	return tree.new_node(Node::node_type::statements, statements);
+}
+
+void inline_functions(SyntaxTree &tree, std::size_t budget) {
+	if (budget == 0) {
+		return;
+	}
+	Inliner inliner(tree, budget);
+	for (auto &function : tree.root->child) {
+		inliner.visit_function(*function);
+	}
+}
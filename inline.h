@@ -0,0 +1,20 @@
+#ifndef INCLUDE_GUARD_INLINE_
+#define INCLUDE_GUARD_INLINE_
+
+#include "ast.h"
+#include <cstddef>
+
+// largest body (in nodes) of a function that is inlined by default
+constexpr std::size_t default_inline_budget = 40;
+
+/**
+ * replace calls of small leaf functions (no calls, no &) with their bodies
+ * a body that is one expression is substituted into the calling expression;
+ * otherwise the call must be a statement (f(...);, x = f(...); or
+ * return f(...);) and becomes a block that assigns the arguments to copies
+ * of the dummy arguments, so it runs once and in order
+ * (runs between Parser::makeAST() and fold_constants(); budget 0 disables)
+ */
+void inline_functions(SyntaxTree &tree, std::size_t budget);
+
+#endif
@@ -0,0 +1,682 @@
+#include "ir.h"
+#include "assembly.h" // number_value
+#include "error.h"
+#include "licm.h"
+#include "tailcall.h"
+#include "variables.h"
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+using opcode_type = IRInstruction::opcode_type;
+
+bool IRInstruction::is_pure() const {
+	switch (opcode) {
+	case opcode_type::constant:
+	case opcode_type::parameter:
+	case opcode_type::add:
+	case opcode_type::subtract:
+	case opcode_type::multiply:
+	case opcode_type::divide:
+	case opcode_type::equal:
+	case opcode_type::not_equal:
+	case opcode_type::less:
+	case opcode_type::less_equal:
+	case opcode_type::greater:
+	case opcode_type::greater_equal:
+	case opcode_type::negate:
+	case opcode_type::address:
+		return true;
+	default:
+		return false;
+	}
+}
+
+std::vector<BlockId>
+    IRBlock::successors(const std::vector<IRInstruction> &values) const {
+	if (instructions.empty()) {
+		return {};
+	}
+	const auto &terminator = values[instructions.back()];
+	switch (terminator.opcode) {
+	case opcode_type::jump:
+		return {terminator.targets[0]};
+	case opcode_type::branch:
+		return {terminator.targets[0], terminator.targets[1]};
+	default:
+		return {};
+	}
+}
+
+namespace {
+/**
+ * SSA construction directly from the AST
+ * (Braun et al., "Simple and Efficient Construction of Static Single
+ * Assignment Form": phi are placed on demand while reading variables, and
+ * the operands of a block's phi are filled in when all of its predecessors
+ * are known, i.e. the block is sealed)
+ */
+class Builder {
+private:
+	// 変数の識別子（Symbol の id、式文の値は result_variable）
+	using Variable = std::uint32_t;
+	static constexpr Variable result_variable =
+	    std::numeric_limits<Variable>::max();
+
+	IRFunction &function;
+	BlockId     current = 0;
+	const Node *definition = nullptr; // 関数定義のノード
+
+	// 末尾位置の呼び出しと、自分自身の末尾呼び出しで戻るブロック
+	std::unordered_set<const Node *> tail_calls;
+	std::optional<BlockId>           recursion;
+
+	// ループ不変式と、ループの前で計算した値
+	LoopInvariants                            invariants;
+	std::unordered_map<const Node *, ValueId> hoisted;
+
+	std::vector<std::unordered_map<Variable, ValueId>> definitions;
+	std::vector<bool>                                  sealed;
+	std::vector<std::vector<std::pair<Variable, ValueId>>> incomplete_phis;
+	std::unordered_set<Symbol> memory_variables; // & を取られた変数
+
+	IRBlock &block(BlockId id) {
+		return function.blocks[id];
+	}
+
+	BlockId new_block() {
+		function.blocks.emplace_back();
+		definitions.emplace_back();
+		sealed.push_back(false);
+		incomplete_phis.emplace_back();
+		return static_cast<BlockId>(function.blocks.size() - 1);
+	}
+
+	ValueId new_value(IRInstruction instruction, BlockId in) {
+		instruction.block = in;
+		function.values.push_back(std::move(instruction));
+		return static_cast<ValueId>(function.values.size() - 1);
+	}
+	// append instruction to the current block
+	ValueId emit(opcode_type opcode, std::vector<ValueId> operands = {},
+	             std::int64_t imm = 0, Symbol symbol = {}) {
+		const auto id =
+		    new_value(IRInstruction{opcode, 0, std::move(operands), imm, symbol},
+		              current);
+		block(current).instructions.push_back(id);
+		return id;
+	}
+	// put instruction at the head of block (after phi if not phi)
+	ValueId emit_front(opcode_type opcode, BlockId in) {
+		const auto id = new_value(IRInstruction{opcode}, in);
+		auto      &instructions = block(in).instructions;
+		auto       position     = instructions.begin();
+		if (opcode_type::phi != opcode) {
+			while (position != instructions.end() &&
+			       opcode_type::phi == function.values[*position].opcode) {
+				++position;
+			}
+		}
+		instructions.insert(position, id);
+		return id;
+	}
+
+	void jump(BlockId target) {
+		auto &instruction      = function.values[emit(opcode_type::jump)];
+		instruction.targets[0] = target;
+		block(target).predecessors.push_back(current);
+	}
+	void branch(ValueId condition, BlockId then, BlockId otherwise) {
+		auto &instruction = function.values[emit(opcode_type::branch, {condition})];
+		instruction.targets[0] = then;
+		instruction.targets[1] = otherwise;
+		block(then).predecessors.push_back(current);
+		block(otherwise).predecessors.push_back(current);
+	}
+
+	void write_variable(Variable variable, BlockId in, ValueId value) {
+		definitions[in][variable] = value;
+	}
+	ValueId read_variable(Variable variable, BlockId in) {
+		if (auto found = definitions[in].find(variable);
+		    found != definitions[in].end()) {
+			return found->second;
+		}
+		return read_variable_recursive(variable, in);
+	}
+	ValueId read_variable_recursive(Variable variable, BlockId in) {
+		ValueId value;
+		if (!sealed[in]) {
+			// 先行ブロックが揃っていないので、後で phi の引数を埋める
+			value = emit_front(opcode_type::phi, in);
+			incomplete_phis[in].emplace_back(variable, value);
+		} else if (block(in).predecessors.empty()) {
+			value = emit_front(opcode_type::undefined, in);
+		} else if (block(in).predecessors.size() == 1) {
+			value = read_variable(variable, block(in).predecessors[0]);
+		} else {
+			// 循環を断つために先に phi を定義しておく
+			value = emit_front(opcode_type::phi, in);
+			write_variable(variable, in, value);
+			value = add_phi_operands(variable, value);
+		}
+		write_variable(variable, in, value);
+		return value;
+	}
+	ValueId add_phi_operands(Variable variable, ValueId phi) {
+		const auto in = function.values[phi].block;
+		for (const auto predecessor : block(in).predecessors) {
+			const auto operand = read_variable(variable, predecessor);
+			function.values[phi].operands.push_back(operand);
+		}
+		return remove_trivial_phi(phi);
+	}
+	/**
+	 * phi(x, x, phi) のように 1 つの値しか合流しない phi はその値の copy にする
+	 * (copy は copy propagation で消える)
+	 */
+	ValueId remove_trivial_phi(ValueId phi) {
+		ValueId same = no_value;
+		for (const auto operand : function.values[phi].operands) {
+			const auto value = function.resolve(operand);
+			if (value == same || value == phi) {
+				continue;
+			}
+			if (same != no_value) {
+				return phi; // 2 つ以上の値が合流する
+			}
+			same = value;
+		}
+		if (same == no_value) {
+			same = emit_front(opcode_type::undefined, function.values[phi].block);
+		}
+		function.values[phi].opcode   = opcode_type::copy;
+		function.values[phi].operands = {same};
+		return phi;
+	}
+	void seal(BlockId in) {
+		for (const auto &[variable, phi] : incomplete_phis[in]) {
+			add_phi_operands(variable, phi);
+		}
+		incomplete_phis[in].clear();
+		sealed[in] = true;
+	}
+
+	// 新しいブロックから続ける（return の後の到達しない文など）
+	void start_block(BlockId id) {
+		current = id;
+	}
+
+	ValueId variable_address(Symbol identifier) {
+		return emit(opcode_type::address, {}, 0, identifier);
+	}
+	ValueId gen_expression(const Node &node);
+	void    gen_statement(const Node &node);
+	bool    gen_self_tail_call(const Node &node);
+
+public:
+	explicit Builder(IRFunction &function)
+	    : function(function) {}
+
+	void build(const Node &node);
+};
+} // namespace
+
+static opcode_type binary_opcode(Node::node_type type) {
+	switch (type) {
+	case Node::node_type::addition:
+		return opcode_type::add;
+	case Node::node_type::subtraction:
+		return opcode_type::subtract;
+	case Node::node_type::multiplication:
+		return opcode_type::multiply;
+	case Node::node_type::division:
+		return opcode_type::divide;
+	case Node::node_type::equal:
+		return opcode_type::equal;
+	case Node::node_type::not_equal:
+		return opcode_type::not_equal;
+	case Node::node_type::less:
+		return opcode_type::less;
+	case Node::node_type::less_equal:
+		return opcode_type::less_equal;
+	case Node::node_type::greater:
+		return opcode_type::greater;
+	case Node::node_type::greater_equal:
+		return opcode_type::greater_equal;
+	default:
+		return opcode_type::nop;
+	}
+}
+
+ValueId Builder::gen_expression(const Node &node) {
+	if (auto found = hoisted.find(&node); found != hoisted.end()) {
+		return found->second;
+	}
+
+	switch (node.type) {
+	case Node::node_type::number:
+		return emit(opcode_type::constant, {}, number_value(node.value));
+
+	case Node::node_type::identifier:
+		if (memory_variables.contains(node.value)) {
+			return emit(opcode_type::load, {variable_address(node.value)});
+		}
+		return read_variable(node.value.id(), current);
+
+	case Node::node_type::assign: {
+		assert(node.child.size() == 2);
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		const auto identifier = node.child[0]->value;
+		const auto value      = gen_expression(*node.child[1]);
+		if (memory_variables.contains(identifier)) {
+			emit(opcode_type::store, {variable_address(identifier), value});
+		} else {
+			write_variable(identifier.id(), current, value);
+		}
+		return value;
+	}
+
+	case Node::node_type::address:
+		assert(node.child.size() == 1);
+		return variable_address(node.child[0]->value);
+
+	case Node::node_type::indirection:
+		assert(node.child.size() == 1);
+		return emit(opcode_type::load, {gen_expression(*node.child[0])});
+
+	case Node::node_type::plus:
+		assert(node.child.size() == 1);
+		return gen_expression(*node.child[0]);
+
+	case Node::node_type::minus:
+		assert(node.child.size() == 1);
+		return emit(opcode_type::negate, {gen_expression(*node.child[0])});
+
+	case Node::node_type::call: {
+		// ネイティブのバックエンドと同じく、引数はレジスタで渡せる 6 個まで
+		if (node.child.size() > 6) {
+			error("too many arguments to " + std::string(node.value.str()));
+		}
+		std::vector<ValueId> arguments;
+		for (const auto &argument : node.child) {
+			arguments.push_back(gen_expression(*argument));
+		}
+		return emit(opcode_type::call, std::move(arguments), 0, node.value);
+	}
+
+	default:
+		break;
+	}
+
+	const auto opcode = binary_opcode(node.type);
+	if (opcode_type::nop == opcode) {
+		error("not implemented type(" +
+		      std::to_string(static_cast<int>(node.type)) + ") on SSA");
+	}
+	assert(node.child.size() == 2);
+	const auto left  = gen_expression(*node.child[0]);
+	const auto right = gen_expression(*node.child[1]);
+	return emit(opcode, {left, right});
+}
+
+/**
+ * 自分自身の末尾呼び出しなら、実引数を仮引数に代入して本体の先頭に戻る
+ * （仮引数は phi で合流する）
+ */
+bool Builder::gen_self_tail_call(const Node &node) {
+	if (!tail_calls.contains(&node) || !is_self_tail_call(*definition, node)) {
+		return false;
+	}
+
+	std::vector<ValueId> arguments;
+	for (const auto &argument : node.child) {
+		arguments.push_back(gen_expression(*argument));
+	}
+	// アドレスを取る関数に末尾呼び出しは無いので、仮引数は全てレジスタ変数
+	const auto parameters = definition->parameters();
+	for (std::size_t i = 0; i < parameters.size(); ++i) {
+		assert(!memory_variables.contains(parameters[i]));
+		write_variable(parameters[i].id(), current, arguments[i]);
+	}
+	jump(*recursion);
+
+	const auto unreachable = new_block();
+	seal(unreachable);
+	start_block(unreachable);
+	return true;
+}
+
+void Builder::gen_statement(const Node &node) {
+	switch (node.type) {
+	case Node::node_type::ifelse_:
+	case Node::node_type::if_: {
+		const bool has_else = Node::node_type::ifelse_ == node.type;
+		assert(node.child.size() == (has_else ? 3 : 2));
+
+		const auto condition = gen_expression(*node.child[0]);
+		const auto then      = new_block();
+		const auto otherwise = has_else ? new_block() : 0;
+		const auto end       = new_block();
+		branch(condition, then, has_else ? otherwise : end);
+		seal(then);
+
+		start_block(then);
+		gen_statement(*node.child[1]);
+		jump(end);
+		if (has_else) {
+			seal(otherwise);
+			start_block(otherwise);
+			gen_statement(*node.child[2]);
+			jump(end);
+		}
+		seal(end);
+		start_block(end);
+		return;
+	}
+
+	case Node::node_type::while_:
+	case Node::node_type::for_: {
+		const bool  is_for    = Node::node_type::for_ == node.type;
+		const auto &condition = *node.child[is_for ? 1 : 0];
+		const auto &body      = *node.child[is_for ? 3 : 1];
+		assert(node.child.size() == (is_for ? 4 : 2));
+
+		if (is_for) {
+			gen_statement(*node.child[0]); // 初期化式
+		}
+		// ループ不変式は header の前で計算する
+		if (auto found = invariants.preheaders.find(&node);
+		    found != invariants.preheaders.end()) {
+			for (const auto invariant : found->second) {
+				hoisted.emplace(invariant, gen_expression(*invariant));
+			}
+		}
+		// 条件式を先頭（1 回目）と末尾で計算する（1 周あたりの分岐は 1 回）
+		// inside は本体からの戻りが揃ってから seal する
+		const auto inside = new_block();
+		const auto exit   = new_block();
+		const auto test   = [&] {
+			if (Node::node_type::number == condition.type &&
+			    number_value(condition.value) != 0) {
+				jump(inside); // 常に真
+			} else {
+				branch(gen_expression(condition), inside, exit);
+			}
+		};
+		test();
+
+		start_block(inside);
+		gen_statement(body);
+		if (is_for) {
+			gen_statement(*node.child[2]); // 変化式
+		}
+		test();
+		seal(inside);
+		seal(exit);
+		start_block(exit);
+		return;
+	}
+
+	case Node::node_type::return_: {
+		assert(node.child.size() == 1);
+		if (gen_self_tail_call(*node.child[0])) {
+			return;
+		}
+		emit(opcode_type::return_, {gen_expression(*node.child[0])});
+
+		// 後続の文は到達しない（dead code elimination で消える）
+		const auto unreachable = new_block();
+		seal(unreachable);
+		start_block(unreachable);
+		return;
+	}
+
+	case Node::node_type::statements:
+		for (const auto &child : node.child) {
+			gen_statement(*child);
+		}
+		return;
+
+	case Node::node_type::empty:
+		return;
+
+	default:
+		if (gen_self_tail_call(node)) {
+			return;
+		}
+		// 式文（関数の末尾に return が無い場合の戻り値になる）
+		write_variable(result_variable, current, gen_expression(node));
+		return;
+	}
+}
+
+void Builder::build(const Node &node) {
+	assert(Node::node_type::function == node.type);
+	assert(node.child.size() == 1);
+	if (node.parameters().size() > 6) {
+		error("too many parameters of " + std::string(node.value.str()));
+	}
+
+	definition                = &node;
+	function.name             = node.value;
+	function.parameter_count  = node.parameters().size();
+	function.memory_variables = find_escaped(node);
+	memory_variables.insert(function.memory_variables.begin(),
+	                        function.memory_variables.end());
+	tail_calls = find_tail_calls(node);
+	invariants = find_loop_invariants(node);
+
+	const auto entry = new_block();
+	seal(entry);
+	start_block(entry);
+
+	/* 仮引数 */
+	for (std::size_t i = 0; i < node.parameters().size(); ++i) {
+		const auto parameter = node.parameters()[i];
+		const auto value =
+		    emit(opcode_type::parameter, {}, static_cast<std::int64_t>(i));
+		if (memory_variables.contains(parameter)) {
+			emit(opcode_type::store, {variable_address(parameter), value});
+		} else {
+			write_variable(parameter.id(), current, value);
+		}
+	}
+
+	// 自分自身の末尾呼び出しは本体の先頭に戻る
+	if (std::any_of(tail_calls.begin(), tail_calls.end(), [&](const Node *call) {
+		    return is_self_tail_call(node, *call);
+	    })) {
+		recursion = new_block();
+		jump(*recursion);
+		start_block(*recursion);
+	}
+
+	gen_statement(*node.child[0]);
+	emit(opcode_type::return_, {read_variable(result_variable, current)});
+	if (recursion) {
+		seal(*recursion);
+	}
+}
+
+IRFunction build_ir(const Node &function) {
+	IRFunction result;
+	Builder(result).build(function);
+	return result;
+}
+
+std::vector<BlockId> reverse_postorder(const IRFunction &function) {
+	std::vector<BlockId> order;
+	std::vector<bool>    visited(function.blocks.size(), false);
+
+	// 再帰すると深い入れ子でスタックが溢れるので、明示的なスタックで辿る
+	std::vector<std::pair<BlockId, std::size_t>> stack{{0, 0}};
+	visited[0] = true;
+	while (!stack.empty()) {
+		auto &[block, index] = stack.back();
+		const auto successors =
+		    function.blocks[block].successors(function.values);
+		if (index < successors.size()) {
+			const auto successor = successors[index++];
+			if (!visited[successor]) {
+				visited[successor] = true;
+				stack.emplace_back(successor, 0);
+			}
+			continue;
+		}
+		order.push_back(block);
+		stack.pop_back();
+	}
+	std::reverse(order.begin(), order.end());
+	return order;
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+std::vector<BlockId> dominators(const IRFunction &function) {
+	const auto order = reverse_postorder(function);
+
+	std::vector<std::size_t> position(function.blocks.size(), 0);
+	for (std::size_t i = 0; i < order.size(); ++i) {
+		position[order[i]] = i;
+	}
+
+	std::vector<BlockId> idom(function.blocks.size(), no_value);
+	idom[0]             = 0;
+	const auto intersect = [&](BlockId a, BlockId b) {
+		while (a != b) {
+			while (position[a] > position[b]) {
+				a = idom[a];
+			}
+			while (position[b] > position[a]) {
+				b = idom[b];
+			}
+		}
+		return a;
+	};
+
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (const auto block : order) {
+			if (block == 0) {
+				continue;
+			}
+			BlockId dominator = no_value;
+			for (const auto predecessor : function.blocks[block].predecessors) {
+				if (idom[predecessor] == no_value) {
+					continue; // まだ処理していないか、到達しない
+				}
+				dominator = dominator == no_value
+				                ? predecessor
+				                : intersect(predecessor, dominator);
+			}
+			if (idom[block] != dominator) {
+				idom[block] = dominator;
+				changed     = true;
+			}
+		}
+	}
+	return idom;
+}
+
+static const char *opcode_name(opcode_type opcode) {
+	switch (opcode) {
+	case opcode_type::constant:
+		return "constant";
+	case opcode_type::parameter:
+		return "parameter";
+	case opcode_type::undefined:
+		return "undefined";
+	case opcode_type::phi:
+		return "phi";
+	case opcode_type::copy:
+		return "copy";
+	case opcode_type::add:
+		return "add";
+	case opcode_type::subtract:
+		return "sub";
+	case opcode_type::multiply:
+		return "mul";
+	case opcode_type::divide:
+		return "div";
+	case opcode_type::equal:
+		return "eq";
+	case opcode_type::not_equal:
+		return "ne";
+	case opcode_type::less:
+		return "lt";
+	case opcode_type::less_equal:
+		return "le";
+	case opcode_type::greater:
+		return "gt";
+	case opcode_type::greater_equal:
+		return "ge";
+	case opcode_type::negate:
+		return "neg";
+	case opcode_type::address:
+		return "address";
+	case opcode_type::load:
+		return "load";
+	case opcode_type::store:
+		return "store";
+	case opcode_type::call:
+		return "call";
+	case opcode_type::jump:
+		return "jump";
+	case opcode_type::branch:
+		return "branch";
+	case opcode_type::return_:
+		return "return";
+	case opcode_type::nop:
+		return "nop";
+	}
+	assert(false);
+	return "";
+}
+
+std::ostream &operator<<(std::ostream &stream, const IRFunction &function) {
+	stream << function.name << ":\n";
+	for (BlockId id = 0; id < function.blocks.size(); ++id) {
+		const auto &block = function.blocks[id];
+		if (block.removed) {
+			continue;
+		}
+		stream << "bb" << id << ":";
+		if (!block.predecessors.empty()) {
+			stream << " ; preds";
+			for (const auto predecessor : block.predecessors) {
+				stream << " bb" << predecessor;
+			}
+		}
+		stream << "\n";
+
+		for (const auto value : block.instructions) {
+			const auto &instruction = function.values[value];
+			stream << "\t";
+			if (instruction.has_value()) {
+				stream << "v" << value << " = ";
+			}
+			stream << opcode_name(instruction.opcode);
+			if (instruction.symbol) {
+				stream << " " << instruction.symbol;
+			}
+			if (opcode_type::constant == instruction.opcode ||
+			    opcode_type::parameter == instruction.opcode) {
+				stream << " " << instruction.imm;
+			}
+			for (std::size_t i = 0; i < instruction.operands.size(); ++i) {
+				stream << (i == 0 ? " v" : ", v") << instruction.operands[i];
+			}
+			if (opcode_type::jump == instruction.opcode) {
+				stream << " bb" << instruction.targets[0];
+			} else if (opcode_type::branch == instruction.opcode) {
+				stream << ", bb" << instruction.targets[0] << ", bb"
+				       << instruction.targets[1];
+			}
+			stream << "\n";
+		}
+	}
+	return stream;
+}
@@ -0,0 +1,114 @@
+#ifndef INCLUDE_GUARD_IR_
+#define INCLUDE_GUARD_IR_
+
+#include "ast.h"
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+/**
+ * SSA intermediate representation of a function
+ *
+ * Every value is defined by exactly one instruction (its index in
+ * IRFunction::values). Variables whose address is never taken are SSA values
+ * (merged by phi at the join points); variables whose address is taken live
+ * in memory and are accessed with explicit load and store.
+ */
+using ValueId = std::uint32_t;
+using BlockId = std::uint32_t;
+
+constexpr ValueId no_value = std::numeric_limits<ValueId>::max();
+
+struct IRInstruction {
+	enum class opcode_type : std::uint8_t {
+		constant,       // imm
+		parameter,      // imm-th dummy argument
+		undefined,      // variable read before assigned
+		phi,            // operands[i] comes from predecessors[i] of the block
+		copy,           // operands[0] (removed by copy propagation)
+		add,
+		subtract,
+		multiply,
+		divide,
+		equal,
+		not_equal,
+		less,
+		less_equal,
+		greater,
+		greater_equal,
+		negate,
+		address,        // address of the memory variable symbol
+		load,           // *operands[0]
+		store,          // *operands[0] = operands[1]
+		call,           // symbol(operands...)
+		jump,           // to targets[0]
+		branch,         // to targets[0] if operands[0] != 0, else targets[1]
+		return_,        // return operands[0]
+		nop             // removed instruction
+	};
+	opcode_type          opcode;
+	BlockId              block = 0;
+	std::vector<ValueId> operands;
+	std::int64_t         imm = 0;
+	Symbol               symbol; // call, address
+	BlockId              targets[2] = {0, 0};
+
+	bool is_terminator() const {
+		return opcode_type::jump == opcode || opcode_type::branch == opcode ||
+		       opcode_type::return_ == opcode;
+	}
+	// has a result (can be an operand)
+	bool has_value() const {
+		return !is_terminator() && opcode_type::store != opcode &&
+		       opcode_type::nop != opcode;
+	}
+	// no side effect, and depends only on operands (can be merged by CSE)
+	bool is_pure() const;
+};
+
+struct IRBlock {
+	std::vector<ValueId> instructions; // phi first, terminator last
+	std::vector<BlockId> predecessors;
+	bool                 removed = false; // unreachable
+
+	std::vector<BlockId> successors(const std::vector<IRInstruction> &values)
+	    const;
+};
+
+struct IRFunction {
+	Symbol                     name;
+	std::size_t                parameter_count = 0;
+	std::vector<IRInstruction> values;
+	std::vector<IRBlock>       blocks; // blocks[0] is the entry
+	std::vector<Symbol>        memory_variables; // whose address is taken
+
+	// terminator of block
+	const IRInstruction &terminator(BlockId block) const {
+		return values[blocks[block].instructions.back()];
+	}
+	// value that value is a copy of (follows chains of copies)
+	ValueId resolve(ValueId value) const {
+		while (IRInstruction::opcode_type::copy == values[value].opcode) {
+			value = values[value].operands[0];
+		}
+		return value;
+	}
+};
+
+// build SSA form of function node
+IRFunction build_ir(const Node &function);
+
+// blocks reachable from the entry in reverse postorder
+std::vector<BlockId> reverse_postorder(const IRFunction &function);
+
+/**
+ * immediate dominator of each block (entry dominates itself)
+ * unreachable blocks have no_value
+ */
+std::vector<BlockId> dominators(const IRFunction &function);
+
+// human-readable listing (--dump)
+std::ostream &operator<<(std::ostream &stream, const IRFunction &function);
+
+#endif
@@ -0,0 +1,413 @@
+#include "ir_codegen.h"
+#include "error.h"
+#include "strength.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <unordered_map>
+
+using opcode_type = IRInstruction::opcode_type;
+
+// 引数に対応するレジスタ
+static constexpr Register target_registers[] = {
+    Register::rdi, Register::rsi, Register::rdx,
+    Register::rcx, Register::r8,  Register::r9};
+
+namespace {
+// 生成中の関数の状態
+struct FunctionState {
+	const IRFunction  &function;
+	Assembly          &out;
+	std::vector<Label> labels; // ブロックの先頭
+
+	/*
+	 * rbp からのオフセット（0 ならスロットを持たない）
+	 * phi は先行ブロックが shadow に書いた値を、ブロックの先頭で slot に写す
+	 * （同時に代入される phi 同士が干渉しないように）
+	 */
+	std::vector<std::int32_t>               slot;
+	std::vector<std::int32_t>               shadow;
+	std::unordered_map<Symbol, std::int32_t> variables; // & を取られた変数
+	std::int64_t                            frame_size = 0;
+	// branch だけが使う比較（0/1 を作らずに cmp と jcc にする）
+	std::vector<bool> fused;
+	// 直後の return で値を返すだけの呼び出し（フレームを畳んで jmp する）
+	std::vector<bool> tail_calls;
+
+	std::int32_t allocate() {
+		frame_size += 8;
+		if (frame_size > std::numeric_limits<std::int32_t>::max()) {
+			error("too many values in " + std::string(function.name.str()));
+		}
+		return static_cast<std::int32_t>(frame_size);
+	}
+
+	// value を reg に読む（定数とアドレスはその場で作る）
+	void load(Register reg, ValueId value) {
+		value                   = function.resolve(value);
+		const auto &instruction = function.values[value];
+		switch (instruction.opcode) {
+		case opcode_type::constant:
+			out.mov(reg, instruction.imm);
+			return;
+		case opcode_type::undefined:
+			out.mov(reg, 0);
+			return;
+		case opcode_type::address:
+			out.lea(reg, memory(Register::rbp,
+			                    -variables.at(instruction.symbol)));
+			return;
+		default:
+			assert(slot[value] != 0);
+			out.mov(reg, memory(Register::rbp, -slot[value]));
+			return;
+		}
+	}
+	void store(ValueId value, Register reg) {
+		out.mov(memory(Register::rbp, -slot[value]), reg);
+	}
+};
+} // namespace
+
+// 値をスロットに置く命令か（それ以外は使う場所で作る）
+static bool needs_slot(const IRInstruction &instruction) {
+	switch (instruction.opcode) {
+	case opcode_type::constant:
+	case opcode_type::undefined:
+	case opcode_type::copy:
+	case opcode_type::address:
+		return false;
+	default:
+		return instruction.has_value();
+	}
+}
+
+static bool is_comparison(opcode_type opcode) {
+	switch (opcode) {
+	case opcode_type::equal:
+	case opcode_type::not_equal:
+	case opcode_type::less:
+	case opcode_type::less_equal:
+	case opcode_type::greater:
+	case opcode_type::greater_equal:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static Condition condition_of(opcode_type opcode) {
+	switch (opcode) {
+	case opcode_type::equal:
+		return Condition::e;
+	case opcode_type::not_equal:
+		return Condition::ne;
+	case opcode_type::less:
+		return Condition::l;
+	case opcode_type::less_equal:
+		return Condition::le;
+	case opcode_type::greater:
+		return Condition::g;
+	case opcode_type::greater_equal:
+		return Condition::ge;
+	default:
+		assert(false);
+		return Condition::e;
+	}
+}
+
+// 後続ブロック successor の phi に渡す値を shadow に書く
+static void gen_edge(BlockId from, BlockId successor, FunctionState &state) {
+	const auto &block = state.function.blocks[successor];
+	const auto  index =
+	    std::find(block.predecessors.begin(), block.predecessors.end(), from) -
+	    block.predecessors.begin();
+	assert(static_cast<std::size_t>(index) < block.predecessors.size());
+
+	for (const auto value : block.instructions) {
+		const auto &instruction = state.function.values[value];
+		if (opcode_type::phi != instruction.opcode) {
+			continue;
+		}
+		state.load(Register::rax, instruction.operands[index]);
+		state.out.mov(memory(Register::rbp, -state.shadow[value]), Register::rax);
+	}
+}
+
+/**
+ * 定数による乗除算をシフトなどで計算する
+ * 被演算子が定数でなければ何もせずに false を返す
+ */
+static bool gen_constant_operation(ValueId value, FunctionState &state) {
+	const auto &function    = state.function;
+	const auto &instruction = function.values[value];
+	const auto  is_constant = [&](std::size_t i) {
+		return opcode_type::constant ==
+		       function.values[function.resolve(instruction.operands[i])].opcode;
+	};
+
+	std::size_t constant = 1;
+	if (!is_constant(1)) {
+		if (opcode_type::divide == instruction.opcode || !is_constant(0)) {
+			return false;
+		}
+		constant = 0;
+	}
+	const auto factor =
+	    function.values[function.resolve(instruction.operands[constant])].imm;
+
+	state.load(Register::rax, instruction.operands[1 - constant]);
+	if (opcode_type::multiply == instruction.opcode) {
+		if (!gen_multiply_constant(state.out, Register::rax, Register::rdi,
+		                           factor)) {
+			state.out.mov(Register::rdi, factor);
+			state.out.imul(Register::rax, Register::rdi);
+		}
+	} else if (!gen_divide_constant(state.out, factor, Register::rdi)) {
+		state.out.mov(Register::rdi, factor);
+		state.out.cqo();
+		state.out.idiv(Register::rdi);
+	}
+	state.store(value, Register::rax);
+	return true;
+}
+
+static void gen_instruction(ValueId value, BlockId next,
+                            FunctionState &state) {
+	auto       &out         = state.out;
+	const auto &instruction = state.function.values[value];
+	const auto &operands    = instruction.operands;
+
+	if (state.fused[value]) {
+		return; // branch で比較する
+	}
+	switch (instruction.opcode) {
+	case opcode_type::constant:
+	case opcode_type::undefined:
+	case opcode_type::copy:
+	case opcode_type::address:
+	case opcode_type::nop:
+		return; // 使う場所で作る
+
+	case opcode_type::parameter:
+		state.store(value, target_registers[instruction.imm]);
+		return;
+
+	case opcode_type::phi:
+		out.mov(Register::rax, memory(Register::rbp, -state.shadow[value]));
+		state.store(value, Register::rax);
+		return;
+
+	case opcode_type::multiply:
+	case opcode_type::divide:
+		if (gen_constant_operation(value, state)) {
+			return;
+		}
+		[[fallthrough]];
+	case opcode_type::add:
+	case opcode_type::subtract:
+	case opcode_type::equal:
+	case opcode_type::not_equal:
+	case opcode_type::less:
+	case opcode_type::less_equal:
+	case opcode_type::greater:
+	case opcode_type::greater_equal:
+		state.load(Register::rax, operands[0]);
+		state.load(Register::rdi, operands[1]);
+		switch (instruction.opcode) {
+		case opcode_type::add:
+			out.add(Register::rax, Register::rdi);
+			break;
+		case opcode_type::subtract:
+			out.sub(Register::rax, Register::rdi);
+			break;
+		case opcode_type::multiply:
+			out.imul(Register::rax, Register::rdi);
+			break;
+		case opcode_type::divide:
+			out.cqo();
+			out.idiv(Register::rdi);
+			break;
+		default:
+			out.cmp(Register::rax, Register::rdi);
+			out.set(condition_of(instruction.opcode), byte(Register::rax));
+			out.movzx(Register::rax, byte(Register::rax));
+			break;
+		}
+		state.store(value, Register::rax);
+		return;
+
+	case opcode_type::negate:
+		state.load(Register::rax, operands[0]);
+		out.neg(Register::rax);
+		state.store(value, Register::rax);
+		return;
+
+	case opcode_type::load:
+		state.load(Register::rax, operands[0]);
+		out.mov(Register::rax, memory(Register::rax));
+		state.store(value, Register::rax);
+		return;
+
+	case opcode_type::store:
+		state.load(Register::rax, operands[0]);
+		state.load(Register::rdi, operands[1]);
+		out.mov(memory(Register::rax), Register::rdi);
+		return;
+
+	case opcode_type::call:
+		assert(operands.size() <= 6);
+		for (std::size_t i = 0; i < operands.size(); ++i) {
+			state.load(target_registers[i], operands[i]);
+		}
+		if (state.tail_calls[value]) {
+			out.mov(Register::rsp, Register::rbp);
+			out.pop(Register::rbp);
+			out.jmp(instruction.symbol);
+			return;
+		}
+		out.call(instruction.symbol);
+		state.store(value, Register::rax);
+		return;
+
+	case opcode_type::jump:
+		gen_edge(instruction.block, instruction.targets[0], state);
+		if (instruction.targets[0] != next) {
+			out.jmp(state.labels[instruction.targets[0]]);
+		}
+		return;
+
+	case opcode_type::branch: {
+		const auto then      = instruction.targets[0];
+		const auto otherwise = instruction.targets[1];
+		gen_edge(instruction.block, then, state);
+		gen_edge(instruction.block, otherwise, state);
+
+		// 条件が比較なら、その被演算子を直接比べる
+		const auto  condition = state.function.resolve(operands[0]);
+		const auto &compare   = state.function.values[condition];
+		auto        holds     = Condition::ne;
+		if (is_comparison(compare.opcode)) {
+			holds = condition_of(compare.opcode);
+			state.load(Register::rax, compare.operands[0]);
+			state.load(Register::rdi, compare.operands[1]);
+			out.cmp(Register::rax, Register::rdi);
+		} else {
+			state.load(Register::rax, condition);
+			out.test(Register::rax, Register::rax);
+		}
+		if (then == next) {
+			out.j(negate(holds), state.labels[otherwise]);
+		} else {
+			out.j(holds, state.labels[then]);
+			if (otherwise != next) {
+				out.jmp(state.labels[otherwise]);
+			}
+		}
+		return;
+	}
+
+	case opcode_type::return_:
+		if (state.tail_calls[state.function.resolve(operands[0])]) {
+			return; // 呼び出し先が直接戻る
+		}
+		state.load(Register::rax, operands[0]);
+		out.mov(Register::rsp, Register::rbp);
+		out.pop(Register::rbp);
+		out.ret();
+		return;
+	}
+	assert(false);
+}
+
+// 使われるのが branch の条件としてだけの比較
+static std::vector<bool> fused_comparisons(const IRFunction &function) {
+	std::vector<std::size_t> uses(function.values.size(), 0);
+	std::vector<bool>        fused(function.values.size(), false);
+	for (const auto &block : function.blocks) {
+		for (const auto value : block.instructions) {
+			const auto &instruction = function.values[value];
+			for (const auto operand : instruction.operands) {
+				++uses[function.resolve(operand)];
+			}
+			if (opcode_type::branch == instruction.opcode) {
+				fused[function.resolve(instruction.operands[0])] = true;
+			}
+		}
+	}
+	for (ValueId value = 0; value < function.values.size(); ++value) {
+		fused[value] = fused[value] && uses[value] == 1 &&
+		               is_comparison(function.values[value].opcode);
+	}
+	return fused;
+}
+
+// ブロックの最後で、その値を return するだけの呼び出し
+static std::vector<bool> tail_calls(const IRFunction &function) {
+	std::vector<bool> tail(function.values.size(), false);
+	if (!function.memory_variables.empty()) {
+		return tail; // アドレスが呼び出し先に渡っているかもしれない
+	}
+	for (const auto &block : function.blocks) {
+		const auto &instructions = block.instructions;
+		if (block.removed || instructions.size() < 2) {
+			continue;
+		}
+		const auto  call   = instructions[instructions.size() - 2];
+		const auto &return_ = function.values[instructions.back()];
+		tail[call] = opcode_type::call == function.values[call].opcode &&
+		             opcode_type::return_ == return_.opcode &&
+		             function.resolve(return_.operands[0]) == call;
+	}
+	return tail;
+}
+
+void gen_ir_function(const IRFunction &function, Assembly &out) {
+	FunctionState state{function, out, {}};
+
+	/* スタックフレームの割り当て */
+	for (const auto variable : function.memory_variables) {
+		state.variables.emplace(variable, state.allocate());
+	}
+	state.fused      = fused_comparisons(function);
+	state.tail_calls = tail_calls(function);
+	state.slot.assign(function.values.size(), 0);
+	state.shadow.assign(function.values.size(), 0);
+	for (ValueId value = 0; value < function.values.size(); ++value) {
+		const auto &instruction = function.values[value];
+		if (!needs_slot(instruction) || state.fused[value] ||
+		    function.blocks[instruction.block].removed) {
+			continue;
+		}
+		state.slot[value] = state.allocate();
+		if (opcode_type::phi == instruction.opcode) {
+			state.shadow[value] = state.allocate();
+		}
+	}
+
+	// ラベル名は関数ごとの名前空間に置く（.L<関数名>.bb<番号>）
+	for (BlockId id = 0; id < function.blocks.size(); ++id) {
+		state.labels.push_back(out.new_label(function.name, "bb", id));
+	}
+
+	out.function(function.name);
+
+	// プロローグ（call の前に rsp を 16 の倍数に揃える）
+	out.push(Register::rbp);
+	out.mov(Register::rbp, Register::rsp);
+	out.sub(Register::rsp, (state.frame_size + 15) / 16 * 16);
+
+	// 到達するブロックだけを逆後順に並べる
+	const auto order = reverse_postorder(function);
+	for (std::size_t i = 0; i < order.size(); ++i) {
+		const auto block = order[i];
+		const auto next =
+		    i + 1 < order.size() ? order[i + 1] : std::numeric_limits<BlockId>::max();
+		if (block != 0) {
+			out.bind(state.labels[block]);
+		}
+		for (const auto value : function.blocks[block].instructions) {
+			gen_instruction(value, next, state);
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#ifndef INCLUDE_GUARD_IR_CODEGEN_
+#define INCLUDE_GUARD_IR_CODEGEN_
+
+#include "assembly.h"
+#include "ir.h"
+
+// lower function in SSA form to instructions
+// (each value has a stack slot; phi are resolved by copies on the edges)
+// functions share no state, so they can be generated concurrently
+void gen_ir_function(const IRFunction &function, Assembly &out);
+
+#endif
@@ -0,0 +1,243 @@
+#include "ir_passes.h"
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <tuple>
+
+using opcode_type = IRInstruction::opcode_type;
+
+// 命令を取り除く（値の番号は変えない）
+static void remove_instructions(IRFunction &function, IRBlock &block,
+                                const std::vector<bool> &keep) {
+	std::erase_if(block.instructions, [&](ValueId value) {
+		if (keep[value]) {
+			return false;
+		}
+		function.values[value].opcode = opcode_type::nop;
+		function.values[value].operands.clear();
+		return true;
+	});
+}
+
+void propagate_copies(IRFunction &function) {
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (auto &block : function.blocks) {
+			if (block.removed) {
+				continue;
+			}
+			for (const auto value : block.instructions) {
+				auto &instruction = function.values[value];
+				for (auto &operand : instruction.operands) {
+					const auto resolved = function.resolve(operand);
+					changed |= resolved != operand;
+					operand = resolved;
+				}
+				if (opcode_type::phi != instruction.opcode) {
+					continue;
+				}
+
+				// 自分自身以外に 1 つの値しか合流しない phi は、その値の copy
+				ValueId same    = no_value;
+				bool    trivial = true;
+				for (const auto operand : instruction.operands) {
+					if (operand == value || operand == same) {
+						continue;
+					}
+					trivial = trivial && same == no_value;
+					same    = operand;
+				}
+				if (trivial && same != no_value) {
+					instruction.opcode   = opcode_type::copy;
+					instruction.operands = {same};
+					changed              = true;
+				}
+			}
+		}
+	}
+
+	// もう参照されない
+	std::vector<bool> keep(function.values.size(), true);
+	for (ValueId value = 0; value < function.values.size(); ++value) {
+		keep[value] = opcode_type::copy != function.values[value].opcode;
+	}
+	for (auto &block : function.blocks) {
+		remove_instructions(function, block, keep);
+	}
+}
+
+static bool is_commutative(opcode_type opcode) {
+	switch (opcode) {
+	case opcode_type::add:
+	case opcode_type::multiply:
+	case opcode_type::equal:
+	case opcode_type::not_equal:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * dominator-based value numbering: a pure instruction is replaced by a copy
+ * of an identical one in a block dominating it
+ * (the table is scoped by walking the dominator tree)
+ */
+void eliminate_common_subexpressions(IRFunction &function) {
+	using Key =
+	    std::tuple<opcode_type, std::int64_t, std::uint32_t, std::vector<ValueId>>;
+
+	const auto idom = dominators(function);
+	std::vector<std::vector<BlockId>> children(function.blocks.size());
+	for (const auto block : reverse_postorder(function)) {
+		if (block != 0) {
+			children[idom[block]].push_back(block);
+		}
+	}
+
+	std::map<Key, ValueId> available;
+	struct Frame {
+		BlockId          block;
+		std::size_t      next_child = 0;
+		std::vector<Key> defined    = {}; // このブロックで表に入れたもの
+	};
+	std::vector<Frame> stack{{0}};
+
+	const auto visit = [&](Frame &frame) {
+		for (const auto value : function.blocks[frame.block].instructions) {
+			auto &instruction = function.values[value];
+			if (!instruction.is_pure()) {
+				continue;
+			}
+			auto operands = instruction.operands;
+			for (auto &operand : operands) {
+				operand = function.resolve(operand);
+			}
+			if (is_commutative(instruction.opcode)) {
+				std::sort(operands.begin(), operands.end());
+			}
+			Key key{instruction.opcode, instruction.imm,
+			        instruction.symbol ? instruction.symbol.id() : 0,
+			        std::move(operands)};
+
+			if (auto found = available.find(key); found != available.end()) {
+				instruction.opcode   = opcode_type::copy;
+				instruction.operands = {found->second};
+			} else {
+				available.emplace(key, value);
+				frame.defined.push_back(std::move(key));
+			}
+		}
+	};
+
+	visit(stack.back());
+	while (!stack.empty()) {
+		auto &frame = stack.back();
+		if (frame.next_child < children[frame.block].size()) {
+			stack.push_back({children[frame.block][frame.next_child++]});
+			visit(stack.back());
+			continue;
+		}
+		for (const auto &key : frame.defined) {
+			available.erase(key);
+		}
+		stack.pop_back();
+	}
+}
+
+void eliminate_dead_code(IRFunction &function) {
+	/* 到達しないブロック */
+	std::vector<bool> reachable(function.blocks.size(), false);
+	for (const auto block : reverse_postorder(function)) {
+		reachable[block] = true;
+	}
+	for (BlockId id = 0; id < function.blocks.size(); ++id) {
+		auto &block = function.blocks[id];
+		if (reachable[id] || block.removed) {
+			continue;
+		}
+		block.removed = true;
+		for (const auto value : block.instructions) {
+			function.values[value].opcode = opcode_type::nop;
+			function.values[value].operands.clear();
+		}
+		block.instructions.clear();
+	}
+	for (BlockId id = 0; id < function.blocks.size(); ++id) {
+		auto &block = function.blocks[id];
+		if (block.removed) {
+			block.predecessors.clear();
+			continue;
+		}
+		// 到達しない先行ブロックから来る phi の引数も除く
+		for (std::size_t i = block.predecessors.size(); i-- > 0;) {
+			if (reachable[block.predecessors[i]]) {
+				continue;
+			}
+			block.predecessors.erase(block.predecessors.begin() + i);
+			for (const auto value : block.instructions) {
+				auto &instruction = function.values[value];
+				if (opcode_type::phi == instruction.opcode) {
+					instruction.operands.erase(instruction.operands.begin() + i);
+				}
+			}
+		}
+	}
+
+	/* 値が使われない命令（副作用のある命令から辿れないもの） */
+	std::vector<bool>    live(function.values.size(), false);
+	std::vector<ValueId> worklist;
+	for (const auto &block : function.blocks) {
+		for (const auto value : block.instructions) {
+			const auto &instruction = function.values[value];
+			if (instruction.is_terminator() ||
+			    opcode_type::store == instruction.opcode ||
+			    opcode_type::call == instruction.opcode) {
+				live[value] = true;
+				worklist.push_back(value);
+			}
+		}
+	}
+	while (!worklist.empty()) {
+		const auto value = worklist.back();
+		worklist.pop_back();
+		for (const auto operand : function.values[value].operands) {
+			if (!live[operand]) {
+				live[operand] = true;
+				worklist.push_back(operand);
+			}
+		}
+	}
+	for (auto &block : function.blocks) {
+		remove_instructions(function, block, live);
+	}
+}
+
+static const IRPass passes[] = {
+    {"copy-propagation", propagate_copies},
+    {"cse", eliminate_common_subexpressions},
+    {"dce", eliminate_dead_code},
+};
+
+const IRPass *find_pass(std::string_view name) {
+	for (const auto &pass : passes) {
+		if (pass.name == name) {
+			return &pass;
+		}
+	}
+	return nullptr;
+}
+
+const std::vector<std::string> &default_passes() {
+	static const std::vector<std::string> names{"dce", "copy-propagation",
+	                                            "cse", "copy-propagation", "dce"};
+	return names;
+}
+
+void run_passes(IRFunction &function, const std::vector<std::string> &names) {
+	for (const auto &name : names) {
+		const auto pass = find_pass(name);
+		assert(pass);
+		pass->run(function);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef INCLUDE_GUARD_IR_PASSES_
+#define INCLUDE_GUARD_IR_PASSES_
+
+#include "ir.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * optimization passes on the SSA IR
+ * a pass rewrites a function in place; removed instructions become nop
+ * (value ids stay stable) and unreachable blocks are marked removed
+ */
+struct IRPass {
+	std::string_view name;
+	void (*run)(IRFunction &function);
+};
+
+// resolve copies and turn phi merging a single value into copies
+void propagate_copies(IRFunction &function);
+// merge pure instructions computing the same value in a dominating block
+void eliminate_common_subexpressions(IRFunction &function);
+// remove unreachable blocks and instructions whose value is never used
+void eliminate_dead_code(IRFunction &function);
+
+// registered pass of name (nullptr if none)
+const IRPass *find_pass(std::string_view name);
+
+// passes run by default, in order
+const std::vector<std::string> &default_passes();
+
+// run passes (names checked by find_pass) in order
+void run_passes(IRFunction &function, const std::vector<std::string> &passes);
+
+#endif
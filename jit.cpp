@@ -0,0 +1,108 @@
+#include "jit.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+struct BuiltinFunction {
+	std::string_view name;
+	void            *address;
+};
+
+/**
+ * C library functions callable from programs run in process
+ * 9cc is linked statically, so dlsym cannot find functions that are not
+ * listed here
+ */
+const BuiltinFunction builtin_functions[] = {
+    {"abs", reinterpret_cast<void *>(&abs)},
+    {"labs", reinterpret_cast<void *>(&labs)},
+    {"putchar", reinterpret_cast<void *>(&putchar)},
+    {"exit", reinterpret_cast<void *>(&exit)},
+    {"malloc", reinterpret_cast<void *>(&malloc)},
+    {"free", reinterpret_cast<void *>(&free)},
+};
+
+// jmp [rip+0] に続けて飛び先の絶対アドレスを置く（rel32 で届かない関数用）
+constexpr std::uint8_t stub_code[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+constexpr std::size_t  stub_size   = sizeof(stub_code) + sizeof(void *);
+} // namespace
+
+[[noreturn]] static void fail(std::string_view message) {
+	std::cerr << message << std::endl;
+	std::exit(EXIT_FAILURE);
+}
+
+void *resolve_external(Symbol function) {
+	for (const auto &builtin : builtin_functions) {
+		if (builtin.name == function.str()) {
+			return builtin.address;
+		}
+	}
+	const std::string name(function.str());
+	if (void *address = dlsym(RTLD_DEFAULT, name.c_str())) {
+		return address;
+	}
+	fail("Undefined function: " + name);
+}
+
+long run(const MachineCode &code) {
+	const MachineCode::Function *entry = nullptr;
+	for (const auto &function : code.functions) {
+		if (function.name.str() == "main") {
+			entry = &function;
+		}
+	}
+	if (!entry) {
+		fail("main is not defined.");
+	}
+
+	/* text の後ろに、未定義の関数への中継コードを並べる */
+	const std::size_t stubs_offset = (code.text.size() + 15) / 16 * 16;
+	const std::size_t size =
+	    stubs_offset + code.relocations.size() * stub_size;
+	const std::size_t page_size = sysconf(_SC_PAGESIZE);
+	const std::size_t mapped_size =
+	    (size + page_size - 1) / page_size * page_size;
+
+	void *memory = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+	                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == memory) {
+		fail("Cannot map memory: "s + std::strerror(errno));
+	}
+	auto *image = static_cast<std::uint8_t *>(memory);
+	std::memcpy(image, code.text.data(), code.text.size());
+
+	for (std::size_t i = 0; i < code.relocations.size(); ++i) {
+		const auto &relocation = code.relocations[i];
+		const auto  stub       = stubs_offset + i * stub_size;
+		void       *target     = resolve_external(relocation.symbol);
+		std::memcpy(image + stub, stub_code, sizeof(stub_code));
+		std::memcpy(image + stub + sizeof(stub_code), &target, sizeof(target));
+
+		// R_X86_64_PLT32: S + A - P（S は中継コード）
+		const auto value = static_cast<std::int32_t>(
+		    static_cast<std::int64_t>(stub) + relocation.addend -
+		    static_cast<std::int64_t>(relocation.offset));
+		std::memcpy(image + relocation.offset, &value, sizeof(value));
+	}
+
+	// 書き込みを終えたら実行可能にする（W と X を同時に立てない）
+	if (mprotect(memory, mapped_size, PROT_READ | PROT_EXEC) != 0) {
+		fail("Cannot make memory executable: "s + std::strerror(errno));
+	}
+
+	const auto main_function =
+	    reinterpret_cast<long (*)()>(image + entry->offset);
+	const long result = main_function();
+
+	munmap(memory, mapped_size);
+	return result;
+}
@@ -0,0 +1,16 @@
+#ifndef INCLUDE_GUARD_JIT_
+#define INCLUDE_GUARD_JIT_
+
+#include "encoder.h"
+
+/**
+ * load code into executable memory of this process and call main
+ * returns the value returned by main
+ */
+long run(const MachineCode &code);
+
+// address of a C library function callable from programs run in process
+// (exits if it is not found)
+void *resolve_external(Symbol function);
+
+#endif
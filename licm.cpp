@@ -0,0 +1,188 @@
+#include "licm.h"
+#include "assembly.h" // number_value
+#include "variables.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+using Counts    = std::unordered_map<Symbol, std::size_t>;
+
+class Analysis {
+private:
+	LoopInvariants         &result;
+	std::span<const Symbol> parameters;
+	Variables               escaped; // & で取られた変数（* で書き換えうる）
+	Counts                  uses;    // 関数全体での変数の出現回数
+
+	// 解析中のループ
+	Variables assigned;    // ループの中で代入される変数
+	Counts    inside_uses; // ループの中での変数の出現回数
+	const Node *loop = nullptr;
+
+	/**
+	 * ループの前で値を読める変数か
+	 * （ループの外でも使う変数でなければ、スコープがループの中にある）
+	 */
+	bool visible(Symbol variable) const {
+		if (std::find(parameters.begin(), parameters.end(), variable) !=
+		    parameters.end()) {
+			return true;
+		}
+		const auto inside = inside_uses.find(variable);
+		return inside == inside_uses.end() || uses.at(variable) > inside->second;
+	}
+
+	// 計算し直すより、ループの前で計算して読む方が得な大きさか
+	std::size_t size(const Node &node) const {
+		if (result.numbers.contains(&node)) {
+			return 1;
+		}
+		std::size_t count = 1;
+		for (const auto &child : node.child) {
+			count += size(*child);
+		}
+		return count;
+	}
+
+	void hoist(const Node &node) {
+		if (size(node) < 3) {
+			return; // 変数や定数を読むのと変わらない
+		}
+		result.numbers.emplace(&node, result.numbers.size());
+		result.preheaders[loop].push_back(&node);
+	}
+
+	bool scan(const Node &node);
+
+public:
+	Analysis(LoopInvariants &result, const Node &function)
+	    : result(result)
+	    , parameters(function.parameters()) {
+		const auto variables = find_escaped(*function.child[0]);
+		escaped              = Variables(variables.begin(), variables.end());
+		count_uses(*function.child[0], uses);
+	}
+
+	static void count_uses(const Node &node, Counts &counts) {
+		if (Node::node_type::identifier == node.type) {
+			++counts[node.value];
+		}
+		for (const auto &child : node.child) {
+			count_uses(*child, counts);
+		}
+	}
+
+	// 外側のループから順に
+	void visit(const Node &node);
+};
+} // namespace
+
+// ループの中で繰り返し実行される子か（for の初期化式は前に 1 回だけ）
+static bool in_loop(const Node &loop, std::size_t index) {
+	return Node::node_type::while_ == loop.type || index != 0;
+}
+
+/**
+ * node がループ不変な式か
+ * 不変でなければ、不変な子（最も大きい式）をループの前に移す
+ */
+bool Analysis::scan(const Node &node) {
+	if (result.numbers.contains(&node)) {
+		return true; // 外側のループの前で計算済み
+	}
+
+	std::vector<bool> invariant;
+	for (const auto &child : node.child) {
+		invariant.push_back(scan(*child));
+	}
+	const bool children = std::all_of(invariant.begin(), invariant.end(),
+	                                  [](bool value) { return value; });
+
+	bool is_invariant;
+	switch (node.type) {
+	case Node::node_type::number:
+	case Node::node_type::address: // 変数のアドレスは変わらない
+		is_invariant = true;
+		break;
+	case Node::node_type::identifier:
+		is_invariant = visible(node.value) && !assigned.contains(node.value);
+		break;
+	case Node::node_type::division: {
+		// 0 除算とオーバーフローで trap しうるので、ループが回らない時に
+		// 計算しても良いのは 0, -1 以外の定数での除算だけ
+		const auto &divisor = *node.child[1];
+		is_invariant = children && Node::node_type::number == divisor.type &&
+		               number_value(divisor.value) != 0 &&
+		               number_value(divisor.value) != -1;
+		break;
+	}
+	case Node::node_type::equal:
+	case Node::node_type::not_equal:
+	case Node::node_type::greater_equal:
+	case Node::node_type::less_equal:
+	case Node::node_type::greater:
+	case Node::node_type::less:
+	case Node::node_type::addition:
+	case Node::node_type::subtraction:
+	case Node::node_type::multiplication:
+	case Node::node_type::plus:
+	case Node::node_type::minus:
+		is_invariant = children;
+		break;
+	default:
+		// 呼び出し、代入、*（呼び出しで書き換えうる）と文
+		is_invariant = false;
+		break;
+	}
+
+	if (!is_invariant) {
+		for (std::size_t i = 0; i < node.child.size(); ++i) {
+			if (invariant[i]) {
+				hoist(*node.child[i]);
+			}
+		}
+	}
+	return is_invariant;
+}
+
+void Analysis::visit(const Node &node) {
+	if (Node::node_type::while_ == node.type ||
+	    Node::node_type::for_ == node.type) {
+		loop     = &node;
+		assigned = escaped;
+		inside_uses.clear();
+		for (std::size_t i = 0; i < node.child.size(); ++i) {
+			if (in_loop(node, i)) {
+				find_assigned(*node.child[i], assigned);
+				count_uses(*node.child[i], inside_uses);
+			}
+		}
+		for (std::size_t i = 0; i < node.child.size(); ++i) {
+			if (in_loop(node, i) && scan(*node.child[i])) {
+				hoist(*node.child[i]);
+			}
+		}
+	}
+
+	for (const auto &child : node.child) {
+		visit(*child);
+	}
+}
+
+std::optional<Operand> InvariantSlots::slot(const Node &node) const {
+	if (!computed.contains(&node)) {
+		return std::nullopt;
+	}
+	const auto number = variable_slots + invariants.numbers.at(&node) + 1;
+	return memory(Register::rbp, -static_cast<std::int32_t>(number * 8));
+}
+
+LoopInvariants find_loop_invariants(const Node &function) {
+	assert(Node::node_type::function == function.type);
+	assert(function.child.size() == 1);
+
+	LoopInvariants result;
+	Analysis       analysis(result, function);
+	analysis.visit(*function.child[0]);
+	return result;
+}
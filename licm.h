@@ -0,0 +1,77 @@
+#ifndef INCLUDE_GUARD_LICM_
+#define INCLUDE_GUARD_LICM_
+
+#include "assembly.h"
+#include "ast.h"
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * loop-invariant code motion
+ * an expression in the condition, step or body of a while_ / for_ is
+ * invariant if it reads only variables the loop never assigns (variables
+ * whose address is taken count as assigned, through *) and cannot trap or
+ * have side effects, so it can be computed once before the loop
+ */
+struct LoopInvariants {
+	// largest invariant expressions to compute before each loop, in order
+	// (an expression is hoisted out of the outermost loop it is invariant in)
+	std::unordered_map<const Node *, std::vector<const Node *>> preheaders;
+	// number of each hoisted expression (0 to count - 1, for stack slots)
+	std::unordered_map<const Node *, std::size_t> numbers;
+
+	std::size_t count() const {
+		return numbers.size();
+	}
+};
+
+LoopInvariants find_loop_invariants(const Node &function);
+
+/**
+ * loop invariants of a function in the stack and register backends
+ * each is computed once before its loop into a slot of the frame after the
+ * variables: [rbp - 8 * (variable_slots + number + 1)]
+ */
+class InvariantSlots {
+private:
+	LoopInvariants                   invariants;
+	std::size_t                      variable_slots = 0;
+	std::unordered_set<const Node *> computed; // スロットに計算済みの不変式
+
+public:
+	InvariantSlots() = default;
+	InvariantSlots(const Node &function, std::size_t variable_slots)
+	    : invariants(find_loop_invariants(function))
+	    , variable_slots(variable_slots) {}
+
+	// number of slots
+	std::size_t count() const {
+		return invariants.count();
+	}
+
+	// slot of node if it is an invariant computed already
+	std::optional<Operand> slot(const Node &node) const;
+
+	/**
+	 * compute the invariants of loop into their slots (before the loop)
+	 * compute(invariant) generates its code and returns the register
+	 * holding the value
+	 */
+	template <typename Compute>
+	void gen_preheader(const Node &loop, Assembly &out, Compute compute) {
+		const auto found = invariants.preheaders.find(&loop);
+		if (found == invariants.preheaders.end()) {
+			return;
+		}
+		for (const auto invariant : found->second) {
+			const Register value = compute(*invariant);
+			computed.insert(invariant);
+			out.mov(*slot(*invariant), value);
+		}
+	}
+};
+
+#endif
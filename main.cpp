@@ -1,34 +1,513 @@
+#include "assembly.h"
+#include "bytecode.h"
+#include "cache.h"
 #include "codegen.h"
+#include "emitter.h"
+#include "encoder.h"
+#include "error.h"
+#include "fold.h"
+#include "inline.h"
+#include "ir_codegen.h"
+#include "ir_passes.h"
+#include "jit.h"
+#include "object.h"
 #include "parser.h"
+#include "peephole.h"
 #include "print.h"
+#include "regcodegen.h"
+#include "source.h"
+#include "thread_pool.h"
 #include "tokenizer.h"
+#include "trace.h"
+#include "unroll.h"
+#include "vm.h"
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
 
-int main(int argc, char *argv[]) {
-	if (argc != 2) {
-		std::cerr << "There are not enough arguments.\n";
-		return EXIT_FAILURE;
+using namespace std::string_literals;
+
+namespace {
+enum class backend_type {
+	stack,     // push/pop stack machine (reference implementation)
+	register_, // expression temporaries in registers
+	ssa        // through the SSA IR and its passes
+};
+
+struct Options {
+	backend_type backend       = backend_type::stack;
+	bool         fold          = true;
+	bool         peephole      = true;
+	std::size_t  inline_budget = default_inline_budget; // 0: no inlining
+	std::size_t  unroll        = default_unroll_factor; // 1: no unrolling
+	bool         object        = false; // ELF object instead of assembly text
+	bool         run_program   = false; // execute in this process
+	bool         interpret     = false; // execute bytecode on the VM
+	bool         dump          = false; // write out tokens and AST (and IR)
+	bool         batch         = false; // arguments are input files
+	std::size_t  jobs          = 0;     // threads (0: all hardware threads)
+	std::vector<std::string> passes = default_passes(); // on the SSA IR
+	// generated code of unchanged functions is reused from here
+	std::optional<CodeCache> cache;
+};
+
+// result of compiling a program
+struct Compilation {
+	std::unique_ptr<SyntaxTree> tree; // assembly refers to its symbols
+	Assembly                    assembly;
+};
+} // namespace
+
+/**
+ * parse program (and inline, fold constants and unroll loops) to syntax tree
+ * with options.dump, tokens and AST are written out to
+ * <dump_prefix>.token.txt and <dump_prefix>.AST.txt
+ */
+static std::unique_ptr<SyntaxTree>
+    parse(std::shared_ptr<const Source> source, const Options &options,
+          const std::string &dump_prefix) {
+	auto tokenizer = [&] {
+		TraceSpan span("tokenize");
+		Tokenizer tokenizer(std::move(source));
+		span.count(tokenizer.size(), "tokens");
+		return tokenizer;
+	}();
+	auto parser = [&] {
+		TraceSpan span("token stream");
+		return Parser(tokenizer);
+	}();
+
+	std::unique_ptr<SyntaxTree> tree;
+	{
+		TraceSpan span("makeAST");
+		tree = parser.makeAST(); // Abstract Syntax Tree
+		if (tracing_enabled()) {
+			span.count(count_nodes(*tree->root), "nodes");
+		}
+	}
+	if (options.dump) {
+		TraceSpan     span("dump");
+		std::ofstream token_file(dump_prefix + ".token.txt");
+		token_file << tokenizer;
+		// write out abstract syntax tree
+		std::ofstream tree_file(dump_prefix + ".AST.txt");
+		tree_file << *tree->root;
+	}
+
+	// inlining of small leaf functions (before folding their arguments in)
+	if (options.inline_budget != 0) {
+		TraceSpan span("inline");
+		inline_functions(*tree, options.inline_budget);
+	}
+	// constant folding and algebraic simplification
+	if (options.fold) {
+		TraceSpan span("fold");
+		fold_constants(*tree);
+	}
+	// unrolling of counted loops (after their bounds are folded to numbers)
+	if (options.unroll > 1) {
+		TraceSpan span("unroll");
+		unroll_loops(*tree, options.unroll);
+	}
+	return tree;
+}
+
+// compile program to instruction list (see parse for dump_prefix)
+// the ssa backend also writes the IR after the passes to <dump_prefix>.IR.txt
+static Compilation compile(std::shared_ptr<const Source> source,
+                           const Options                &options,
+                           const std::string            &dump_prefix,
+                           std::size_t                   jobs) {
+	Compilation result;
+	result.tree = parse(std::move(source), options, dump_prefix);
+
+	TraceSpan codegen_span("codegen");
+
+	// cached code refers to symbols of this tree (interning is not thread-safe)
+	std::mutex intern_mutex;
+	const auto intern = [&](std::string_view text) {
+		std::lock_guard lock(intern_mutex);
+		return result.tree->intern(text);
+	};
+
+	// calculate each function on worker threads into its own buffer
+	const auto           &functions = result.tree->root->child;
+	std::vector<Assembly> parts(functions.size());
+	std::vector<std::ostringstream> ir_dumps(
+	    options.dump && backend_type::ssa == options.backend ? functions.size()
+	                                                         : 0);
+	ThreadPool(jobs).parallel_for(functions.size(), [&](std::size_t i) {
+		TraceSpan     span(functions[i]->value.str(), "function");
+		std::uint64_t key = 0;
+		if (options.cache) {
+			// the code depends on the backend and the optimizations as well
+			auto seed = static_cast<std::uint64_t>(options.backend) |
+			            (options.peephole ? 0x100 : 0);
+			if (backend_type::ssa == options.backend) {
+				for (const auto &pass : options.passes) {
+					for (const char c : pass + ",") {
+						seed = seed * 131 + static_cast<unsigned char>(c);
+					}
+				}
+			}
+			key             = hash_function(*functions[i], seed);
+			if (options.cache->load(key, intern, parts[i])) {
+				return;
+			}
+		}
+
+		switch (options.backend) {
+		case backend_type::stack:
+			gen_function(*functions[i], parts[i]);
+			break;
+		case backend_type::register_:
+			gen_register_function(*functions[i], parts[i]);
+			break;
+		case backend_type::ssa: {
+			auto function = build_ir(*functions[i]);
+			run_passes(function, options.passes);
+			if (options.dump) {
+				ir_dumps[i] << function;
+			}
+			gen_ir_function(function, parts[i]);
+			break;
+		}
+		}
+		if (options.peephole) {
+			optimize_peephole(parts[i]);
+		}
+
+		if (options.cache) {
+			options.cache->store(key, parts[i]);
+		}
+	});
+
+	// concatenate in source order (same output whatever the number of jobs)
+	for (const auto &part : parts) {
+		result.assembly.append(part);
+	}
+	if (!ir_dumps.empty()) {
+		std::ofstream ir_file(dump_prefix + ".IR.txt");
+		for (const auto &dump : ir_dumps) {
+			ir_file << dump.str();
+		}
+	}
+	codegen_span.count(result.assembly.instructions.size(), "instructions");
+	return result;
+}
+
+// write out as object file or assembly text
+static void write_output(const Assembly &assembly, const Options &options,
+                         const char *output_path) {
+	int output_fd = STDOUT_FILENO;
+	if (output_path) {
+		output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (output_fd < 0) {
+			error("Cannot open "s + output_path + ": " + std::strerror(errno));
+		}
+	}
+
+	{
+		Emitter out(output_fd);
+		// assemble by ourselves, or leave it to an external assembler
+		if (options.object) {
+			auto code = [&] {
+				TraceSpan span("encode");
+				auto      code = encode(assembly);
+				span.count(code.text.size(), "bytes");
+				return code;
+			}();
+			TraceSpan span("write output");
+			write_object(code, out);
+			out.flush();
+			span.count(out.size(), "bytes");
+		} else {
+			TraceSpan span("write output");
+			write_text(assembly, out);
+			out.flush();
+			span.count(out.size(), "bytes");
+		}
+	}
+
+	if (output_path) {
+		close(output_fd);
 	}
+}
+
+// path with its extension replaced ("dir/foo.c" -> "dir/foo.s")
+static std::string replace_extension(std::string_view path,
+                                     std::string_view extension) {
+	const auto slash = path.rfind('/');
+	const auto dot   = path.rfind('.');
+	if (dot != std::string_view::npos &&
+	    (slash == std::string_view::npos || slash < dot)) {
+		path = path.substr(0, dot);
+	}
+	return std::string(path).append(extension);
+}
 
-	Tokenizer     tokenizer(argv[1]);
-	Parser        parser(tokenizer);
-	std::ofstream token_file(".token.txt");
-	token_file << tokenizer;
-	token_file.close();
+/**
+ * compile each input file to <input>.s (or .o) concurrently
+ * each file is one job (its functions are generated on the same thread)
+ * reports aggregate throughput to stderr
+ */
+static int compile_files(const std::vector<const char *> &paths,
+                         const Options                   &options) {
+	const auto start = std::chrono::steady_clock::now();
 
-	// first half of assembler
-	std::cout << ".intel_syntax noprefix\n"
-	             ".global main\n";
+	std::vector<std::string> messages(paths.size()); // errors of each job
+	std::vector<std::size_t> bytes(paths.size(), 0);
+	std::vector<std::size_t> functions(paths.size(), 0);
 
-	const auto AST = parser.makeAST(); // Abstract Syntax Tree
-	// write out abstract syntax tree
-	std::ofstream tree_file(".AST.txt");
-	tree_file << *AST;
-	tree_file.close();
+	ThreadPool pool(options.jobs);
+	pool.parallel_for(paths.size(), [&](std::size_t i) {
+		try {
+			auto source = [&] {
+				TraceSpan span("read source");
+				return Source::from_file(paths[i]);
+			}();
+			bytes[i] = source->text().size();
+
+			const auto result = compile(std::move(source), options, paths[i], 1);
+			functions[i]      = result.tree->root->child.size();
+			write_output(result.assembly, options,
+			             replace_extension(paths[i], options.object ? ".o" : ".s")
+			                 .c_str());
+		} catch (const CompileError &e) {
+			messages[i] = e.what();
+		}
+	});
+
+	const std::chrono::duration<double> elapsed =
+	    std::chrono::steady_clock::now() - start;
+
+	std::size_t failures = 0, total_bytes = 0, total_functions = 0;
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+		if (!messages[i].empty()) {
+			std::cerr << paths[i] << ":\n" << messages[i] << "\n";
+			++failures;
+		}
+		total_bytes += bytes[i];
+		total_functions += functions[i];
+	}
 
-	// calculate whole node
-	gen(*AST);
+	const double seconds = std::max(elapsed.count(), 1e-9);
+	std::cerr << std::fixed << std::setprecision(3) << "Compiled "
+	          << paths.size() - failures << "/" << paths.size() << " files ("
+	          << total_bytes << " bytes, " << total_functions
+	          << " functions) in " << seconds << " s with " << pool.size()
+	          << " threads: " << std::setprecision(1)
+	          << paths.size() / seconds << " files/s, "
+	          << total_bytes / seconds / 1e6 << " MB/s\n";
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * compile a program to output_path (or run it with --run)
+ * input is a file name ("-" is stdin) if is_file, or the program itself
+ */
+static int compile_program(const char *input, bool is_file,
+                           const Options &options, const char *output_path) {
+	try {
+		std::shared_ptr<const Source> source;
+		{
+			TraceSpan span("read source");
+			if (!is_file) {
+				source = Source::from_text(input);
+			} else if (std::string_view(input) == "-") {
+				source = Source::from_stream(STDIN_FILENO);
+			} else {
+				source = Source::from_file(input);
+			}
+		}
+
+		// VM: run the program as bytecode (no machine code at all)
+		if (options.interpret) {
+			const auto tree     = parse(std::move(source), options, "");
+			const auto bytecode = [&] {
+				TraceSpan span("bytecode");
+				auto      bytecode = compile_bytecode(*tree);
+				span.count(bytecode.code.size(), "instructions");
+				return bytecode;
+			}();
+			TraceSpan span("interpret");
+			return static_cast<int>(interpret(bytecode));
+		}
+
+		auto result = compile(std::move(source), options, "", options.jobs);
+
+		// JIT: run main in this process and exit with its value
+		if (options.run_program) {
+			auto code = [&] {
+				TraceSpan span("encode");
+				return encode(result.assembly);
+			}();
+			TraceSpan span("run");
+			return static_cast<int>(run(code));
+		}
+		write_output(result.assembly, options, output_path);
+	} catch (const CompileError &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
 
 	return EXIT_SUCCESS;
 }
+
+int main(int argc, char *argv[]) {
+	Options                   options;
+	const char               *output_path = nullptr; // stdout if not given
+	const char               *input_path  = nullptr; // "-" is stdin
+	bool                      stats       = false;   // summary to stderr
+	bool                      stats_tsv   = false;   // the summary as TSV
+	const char               *trace_path  = nullptr; // Chrome trace JSON
+	std::vector<const char *> inputs;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view argument = argv[i];
+
+		if (argument == "--backend=stack") {
+			options.backend = backend_type::stack;
+		} else if (argument == "--backend=register") {
+			options.backend = backend_type::register_;
+		} else if (argument == "--backend=ssa") {
+			options.backend = backend_type::ssa;
+		} else if (argument.starts_with("--passes=")) {
+			// comma separated (empty: no pass)
+			options.passes.clear();
+			auto list = argument.substr(std::strlen("--passes="));
+			while (!list.empty()) {
+				const auto comma = std::min(list.find(','), list.size());
+				const auto name  = list.substr(0, comma);
+				if (!find_pass(name)) {
+					std::cerr << "Unknown pass: " << name << "\n";
+					return EXIT_FAILURE;
+				}
+				options.passes.emplace_back(name);
+				list.remove_prefix(std::min(comma + 1, list.size()));
+			}
+		} else if (argument == "--no-fold") {
+			options.fold = false;
+		} else if (argument == "--no-peephole") {
+			options.peephole = false;
+		} else if (argument == "--no-inline") {
+			options.inline_budget = 0;
+		} else if (argument.starts_with("--inline-budget=")) {
+			const auto value = argument.substr(std::strlen("--inline-budget="));
+			const auto end   = value.data() + value.size();
+			auto [last, ec] =
+			    std::from_chars(value.data(), end, options.inline_budget);
+			if (ec != std::errc() || last != end) {
+				std::cerr << "Invalid inline budget: " << value << "\n";
+				return EXIT_FAILURE;
+			}
+		} else if (argument.starts_with("--unroll=")) {
+			const auto value = argument.substr(std::strlen("--unroll="));
+			const auto end   = value.data() + value.size();
+			auto [last, ec]  = std::from_chars(value.data(), end, options.unroll);
+			if (ec != std::errc() || last != end || options.unroll == 0) {
+				std::cerr << "Invalid unroll factor: " << value << "\n";
+				return EXIT_FAILURE;
+			}
+		} else if (argument.starts_with("--jobs=")) {
+			const auto value = argument.substr(std::strlen("--jobs="));
+			const auto end   = value.data() + value.size();
+			auto [last, ec]  = std::from_chars(value.data(), end, options.jobs);
+			if (ec != std::errc() || last != end) {
+				std::cerr << "Invalid number of jobs: " << value << "\n";
+				return EXIT_FAILURE;
+			}
+		} else if (argument.starts_with("--cache=")) {
+			try {
+				options.cache.emplace(
+				    std::string(argument.substr(std::strlen("--cache="))));
+			} catch (const CompileError &e) {
+				std::cerr << e.what() << "\n";
+				return EXIT_FAILURE;
+			}
+		} else if (argument == "--stats") {
+			stats = true;
+		} else if (argument == "--stats=tsv") {
+			stats     = true;
+			stats_tsv = true;
+		} else if (argument.starts_with("--trace=")) {
+			trace_path = argv[i] + std::strlen("--trace=");
+		} else if (argument == "--run") {
+			options.run_program = true;
+		} else if (argument == "--vm") {
+			options.interpret = true;
+		} else if (argument == "--dump") {
+			options.dump = true;
+		} else if (argument == "--batch") {
+			options.batch = true;
+		} else if (argument == "-c") {
+			options.object = true;
+		} else if (argument == "-o") {
+			if (++i == argc) {
+				std::cerr << "An output file name was expected after -o.\n";
+				return EXIT_FAILURE;
+			}
+			output_path = argv[i];
+		} else if (argument == "-f") {
+			if (++i == argc) {
+				std::cerr << "An input file name was expected after -f.\n";
+				return EXIT_FAILURE;
+			}
+			input_path = argv[i];
+		} else if (argument.starts_with("--")) {
+			std::cerr << "Unknown option: " << argument << "\n";
+			return EXIT_FAILURE;
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+
+	if (stats || trace_path) {
+		enable_tracing();
+	}
+
+	int status;
+	if (options.batch) {
+		// batch: every argument is an input file, and each has its own output
+		if (output_path || input_path || options.run_program ||
+		    options.interpret) {
+			std::cerr << "-o, -f, --run and --vm cannot be used with --batch.\n";
+			return EXIT_FAILURE;
+		}
+		status = compile_files(inputs, options);
+	} else {
+		// the program is given as a file (-f) or as the argument itself
+		if (!input_path && inputs.empty()) {
+			std::cerr << "There are not enough arguments.\n";
+			return EXIT_FAILURE;
+		}
+		if (inputs.size() > (input_path ? 0 : 1)) {
+			std::cerr << "There are too many arguments.\n";
+			return EXIT_FAILURE;
+		}
+		status = compile_program(input_path ? input_path : inputs[0],
+		                         input_path != nullptr, options, output_path);
+	}
+
+	if (stats_tsv) {
+		write_trace_tsv(std::cerr);
+	} else if (stats) {
+		write_trace_summary(std::cerr);
+	}
+	if (trace_path) {
+		std::ofstream trace_file(trace_path);
+		write_trace_json(trace_file);
+	}
+	return status;
+}
@@ -0,0 +1,180 @@
+#include "object.h"
+#include <cstring>
+#include <elf.h>
+#include <string>
+#include <unordered_map>
+
+namespace {
+// section header table の並び
+enum section_index : Elf64_Half {
+	null_section,
+	text_section,
+	rela_text_section,
+	note_gnu_stack_section,
+	symtab_section,
+	strtab_section,
+	shstrtab_section,
+	section_count
+};
+
+// 文字列表（先頭は空文字列）
+class StringTable {
+private:
+	std::string table{'\0'};
+
+public:
+	Elf64_Word add(std::string_view name) {
+		const auto offset = static_cast<Elf64_Word>(table.size());
+		table.append(name);
+		table.push_back('\0');
+		return offset;
+	}
+	const std::string &str() const {
+		return table;
+	}
+};
+} // namespace
+
+template <class T>
+static void append(std::string &file, const T &value) {
+	file.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+static void align(std::string &file, std::size_t alignment) {
+	file.resize((file.size() + alignment - 1) / alignment * alignment, '\0');
+}
+
+void write_object(const MachineCode &code, Emitter &out) {
+	/* 記号表（局所記号が先、大域記号が後） */
+	StringTable                            strtab;
+	std::vector<Elf64_Sym>                 symbols(1, Elf64_Sym{});
+	std::unordered_map<Symbol, Elf64_Word> symbol_index;
+
+	const auto add_function = [&](const MachineCode::Function &function,
+	                              unsigned char                 binding) {
+		Elf64_Sym symbol{};
+		symbol.st_name  = strtab.add(function.name.str());
+		symbol.st_info  = ELF64_ST_INFO(binding, STT_FUNC);
+		symbol.st_shndx = text_section;
+		symbol.st_value = function.offset;
+		symbol.st_size  = function.size;
+		symbol_index.emplace(function.name,
+		                     static_cast<Elf64_Word>(symbols.size()));
+		symbols.push_back(symbol);
+	};
+	for (const auto &function : code.functions) {
+		if (!is_global_function(function.name)) {
+			add_function(function, STB_LOCAL);
+		}
+	}
+	const auto first_global = static_cast<Elf64_Word>(symbols.size());
+	for (const auto &function : code.functions) {
+		if (is_global_function(function.name)) {
+			add_function(function, STB_GLOBAL);
+		}
+	}
+	// 未定義の関数（リンク時に解決される）
+	for (const auto &relocation : code.relocations) {
+		if (symbol_index.contains(relocation.symbol)) {
+			continue;
+		}
+		Elf64_Sym symbol{};
+		symbol.st_name  = strtab.add(relocation.symbol.str());
+		symbol.st_info  = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+		symbol.st_shndx = SHN_UNDEF;
+		symbol_index.emplace(relocation.symbol,
+		                     static_cast<Elf64_Word>(symbols.size()));
+		symbols.push_back(symbol);
+	}
+
+	/* ファイルの中身（ELF ヘッダの後に各セクション、最後にセクションヘッダ） */
+	std::string file(sizeof(Elf64_Ehdr), '\0');
+	Elf64_Shdr  sections[section_count]{};
+	StringTable shstrtab;
+
+	align(file, 16);
+	sections[text_section].sh_name      = shstrtab.add(".text");
+	sections[text_section].sh_type      = SHT_PROGBITS;
+	sections[text_section].sh_flags     = SHF_ALLOC | SHF_EXECINSTR;
+	sections[text_section].sh_offset    = file.size();
+	sections[text_section].sh_size      = code.text.size();
+	sections[text_section].sh_addralign = 16;
+	file.append(reinterpret_cast<const char *>(code.text.data()),
+	            code.text.size());
+
+	align(file, 8);
+	sections[rela_text_section].sh_name      = shstrtab.add(".rela.text");
+	sections[rela_text_section].sh_type      = SHT_RELA;
+	sections[rela_text_section].sh_flags     = SHF_INFO_LINK;
+	sections[rela_text_section].sh_offset    = file.size();
+	sections[rela_text_section].sh_size =
+	    code.relocations.size() * sizeof(Elf64_Rela);
+	sections[rela_text_section].sh_link      = symtab_section;
+	sections[rela_text_section].sh_info      = text_section;
+	sections[rela_text_section].sh_addralign = 8;
+	sections[rela_text_section].sh_entsize   = sizeof(Elf64_Rela);
+	for (const auto &relocation : code.relocations) {
+		Elf64_Rela rela{};
+		rela.r_offset = relocation.offset;
+		rela.r_info   = ELF64_R_INFO(symbol_index.at(relocation.symbol),
+		                             R_X86_64_PLT32);
+		rela.r_addend = relocation.addend;
+		append(file, rela);
+	}
+
+	// 実行可能スタックを要求しない
+	sections[note_gnu_stack_section].sh_name =
+	    shstrtab.add(".note.GNU-stack");
+	sections[note_gnu_stack_section].sh_type      = SHT_PROGBITS;
+	sections[note_gnu_stack_section].sh_offset    = file.size();
+	sections[note_gnu_stack_section].sh_addralign = 1;
+
+	sections[symtab_section].sh_name      = shstrtab.add(".symtab");
+	sections[symtab_section].sh_type      = SHT_SYMTAB;
+	sections[symtab_section].sh_offset    = file.size();
+	sections[symtab_section].sh_size      = symbols.size() * sizeof(Elf64_Sym);
+	sections[symtab_section].sh_link      = strtab_section;
+	sections[symtab_section].sh_info      = first_global;
+	sections[symtab_section].sh_addralign = 8;
+	sections[symtab_section].sh_entsize   = sizeof(Elf64_Sym);
+	for (const auto &symbol : symbols) {
+		append(file, symbol);
+	}
+
+	sections[strtab_section].sh_name      = shstrtab.add(".strtab");
+	sections[strtab_section].sh_type      = SHT_STRTAB;
+	sections[strtab_section].sh_offset    = file.size();
+	sections[strtab_section].sh_size      = strtab.str().size();
+	sections[strtab_section].sh_addralign = 1;
+	file.append(strtab.str());
+
+	sections[shstrtab_section].sh_name      = shstrtab.add(".shstrtab");
+	sections[shstrtab_section].sh_type      = SHT_STRTAB;
+	sections[shstrtab_section].sh_offset    = file.size();
+	sections[shstrtab_section].sh_size      = shstrtab.str().size();
+	sections[shstrtab_section].sh_addralign = 1;
+	file.append(shstrtab.str());
+
+	align(file, 8);
+	const auto section_header_offset = file.size();
+	for (const auto &section : sections) {
+		append(file, section);
+	}
+
+	Elf64_Ehdr header{};
+	std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS]   = ELFCLASS64;
+	header.e_ident[EI_DATA]    = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI]   = ELFOSABI_SYSV;
+	header.e_type              = ET_REL;
+	header.e_machine           = EM_X86_64;
+	header.e_version           = EV_CURRENT;
+	header.e_shoff             = section_header_offset;
+	header.e_ehsize            = sizeof(Elf64_Ehdr);
+	header.e_shentsize         = sizeof(Elf64_Shdr);
+	header.e_shnum             = section_count;
+	header.e_shstrndx          = shstrtab_section;
+	std::memcpy(file.data(), &header, sizeof(header));
+
+	out << std::string_view(file);
+}
@@ -0,0 +1,10 @@
+#ifndef INCLUDE_GUARD_OBJECT_
+#define INCLUDE_GUARD_OBJECT_
+
+#include "emitter.h"
+#include "encoder.h"
+
+// write out as ELF64 relocatable object file (x86-64)
+void write_object(const MachineCode &code, Emitter &out);
+
+#endif
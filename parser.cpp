@@ -1,5 +1,6 @@
 #include "parser.h"
 #include "error.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -48,45 +49,40 @@ bool Parser::consume(std::string_view op) {
 void Parser::expect(std::string_view op) {
 	if (tokenListIsEmpty()) {
 		const auto &lastPoppedToken = getLastPoppedToken();
-		error("Token '"s + op + "' was expected, but not.", lastPoppedToken.line,
-		      lastPoppedToken.line_num,
-		      lastPoppedToken.pos + lastPoppedToken.value.size());
+		error("Token '"s + op + "' was expected, but not.", lastPoppedToken,
+		      lastPoppedToken.value.size());
 	}
 
 	if (!consume(op)) {
 		const auto &current_token = getFrontToken();
-		error("Token '"s + op + "' was expected, but not.", current_token.line,
-		      current_token.line_num, current_token.pos);
+		error("Token '"s + op + "' was expected, but not.", current_token);
 	}
 }
-std::string Parser::expect_number() {
+Symbol Parser::expect_number() {
 	if (tokenListIsEmpty()) {
 		const auto &lastPoppedToken = getLastPoppedToken();
-		error("A numeric token was expected, but not.", lastPoppedToken.line,
-		      lastPoppedToken.line_num,
-		      lastPoppedToken.pos + lastPoppedToken.value.size());
+		error("A numeric token was expected, but not.", lastPoppedToken,
+		      lastPoppedToken.value.size());
 	}
 
-	const auto  current_token = getFrontToken();
-	const auto &token         = current_token.value;
+	const auto current_token = getFrontToken();
+	const auto token         = current_token.value;
 	popFrontToken();
 	if (!std::all_of(token.begin(), token.end(), isdigit)) {
-		error("A numeric token was expected, but not.", current_token.line,
-		      current_token.line_num, current_token.pos);
+		error("A numeric token was expected, but not.", current_token);
 	}
 
-	return token;
+	return tree->intern(token);
 }
-std::string Parser::expect_identifier() {
+Symbol Parser::expect_identifier() {
 	if (tokenListIsEmpty()) {
 		const auto &lastPoppedToken = getLastPoppedToken();
-		error("An identifier token was expected, but not.", lastPoppedToken.line,
-		      lastPoppedToken.line_num,
-		      lastPoppedToken.pos + lastPoppedToken.value.size());
+		error("An identifier token was expected, but not.", lastPoppedToken,
+		      lastPoppedToken.value.size());
 	}
 
-	const auto  current_token = getFrontToken();
-	const auto &token         = current_token.value;
+	const auto current_token = getFrontToken();
+	const auto token         = current_token.value;
 	popFrontToken();
 
 	if ("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_"s.find(
@@ -94,128 +90,120 @@ std::string Parser::expect_identifier() {
 	    token.find_first_not_of(
 	        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_0123456789") !=
 	        token.npos) {
-		error("An identifier token was expected, but not.", current_token.line,
-		      current_token.line_num, current_token.pos);
+		error("An identifier token was expected, but not.", current_token);
 	}
 
-	return token;
+	return tree->intern(token);
 }
-std::unique_ptr<Node> Parser::new_node(Node::node_type    type,
-                                       const std::string &value) {
-	std::unique_ptr<Node> node(new Node(type));
-	node->value = value;
-	return node;
-}
-
-std::unique_ptr<Node> Parser::program() {
-	std::unique_ptr<Node> node(new Node(Node::node_type::statements));
+Node *Parser::program() {
+	const auto functions = begin_children();
 
 	while (!tokenListIsEmpty()) {
-		node->child.push_back(function());
+		pending_children.push_back(function());
 	}
 
-	return node;
+	return tree->new_node(Node::node_type::statements, end_children(functions));
 }
-std::unique_ptr<Node> Parser::function() {
-	std::unique_ptr<Node> node(new Node(Node::node_type::function));
-
+Node *Parser::function() {
 	// function name
-	node->value = expect_identifier();
+	const auto name = expect_identifier();
 
 	// dummy argument names
+	std::vector<Symbol> parameters;
 	expect("(");
 	if (!consume(")")) {
-		node->identifier_list.push_back(expect_identifier());
+		parameters.push_back(expect_identifier());
 		while (consume(",")) {
-			node->identifier_list.push_back(expect_identifier());
+			parameters.push_back(expect_identifier());
 		}
 		expect(")");
 	}
 
 	// function statements
-	std::unique_ptr<Node> function_body(new Node(Node::node_type::statements));
+	const auto statements = begin_children();
 	expect("{");
 	while (!consume("}")) {
-		function_body->child.push_back(statement());
+		pending_children.push_back(statement());
 	}
-	node->child.push_back(std::move(function_body));
+	const auto function_body = tree->new_node(Node::node_type::statements,
+	                                          end_children(statements));
 
-	return node;
+	return tree->new_function(name, parameters, function_body);
 }
-std::unique_ptr<Node> Parser::statement() {
-	std::unique_ptr<Node> node;
+Node *Parser::statement() {
+	Node *node;
 
 	if (consume("{")) {
-		node = new_node(Node::node_type::statements);
 		// compound statement
+		const auto statements = begin_children();
 
 		while (!consume("}")) {
-			node->child.push_back(statement());
+			pending_children.push_back(statement());
 		}
+		node = tree->new_node(Node::node_type::statements,
+		                      end_children(statements));
 	} else if (consume("return")) {
 		node = new_node(Node::node_type::return_, expression());
 		expect(";");
 	} else if (consume("if")) {
-		node = new_node(Node::node_type::if_);
-
 		expect("(");
-		node->child.push_back(expression());
+		const auto condition = expression();
 		expect(")");
-		node->child.push_back(statement());
+		const auto then_statement = statement();
 
 		// ただの if ではなく if-else の場合
 		if (consume("else")) {
-			auto ifnode = std::move(node);
-
-			node = new_node(Node::node_type::ifelse_, std::move(ifnode->child.at(0)),
-			                std::move(ifnode->child.at(1)), statement());
+			node = new_node(Node::node_type::ifelse_, condition, then_statement,
+			                statement());
+		} else {
+			node = new_node(Node::node_type::if_, condition, then_statement);
 		}
 	} else if (consume("for")) {
-		node = new_node(Node::node_type::for_);
-
 		expect("(");
 
 		/* 初期化式 */
 		// 式が無ければ、1、あればそれにする
+		Node *initialization;
 		if (consume(";")) {
-			node->child.push_back(new_node(Node::node_type::number, "1"s));
+			initialization = new_node(Node::node_type::number, tree->intern("1"));
 		} else {
-			node->child.push_back(expression());
+			initialization = expression();
 			expect(";");
 		}
 
 		/* 条件式 */
 		// 式が無ければ、1、あればそれにする
+		Node *condition;
 		if (consume(";")) {
-			node->child.push_back(new_node(Node::node_type::number, "1"s));
+			condition = new_node(Node::node_type::number, tree->intern("1"));
 		} else {
-			node->child.push_back(expression());
+			condition = expression();
 			expect(";");
 		}
 
 		/* 変化式 */
 		// 式が無ければ、1、あればそれにする
+		Node *step;
 		if (consume(")")) {
-			node->child.push_back(new_node(Node::node_type::number, "1"s));
+			step = new_node(Node::node_type::number, tree->intern("1"));
 		} else {
-			node->child.push_back(expression());
+			step = expression();
 			expect(")");
 		}
 
 		// 文
-		node->child.push_back(statement());
+		node = new_node(Node::node_type::for_, initialization, condition, step,
+		                statement());
 	} else if (consume("while")) {
-		node = new_node(Node::node_type::while_);
-
 		expect("(");
 
 		// 条件式
-		node->child.push_back(expression());
+		const auto condition = expression();
 
 		expect(")");
 
 		// 文
-		node->child.push_back(statement());
+		node = new_node(Node::node_type::while_, condition, statement());
 	} else {
 		node = expression();
 		expect(";");
@@ -223,76 +211,75 @@ std::unique_ptr<Node> Parser::statement() {
 
 	return node;
 }
-std::unique_ptr<Node> Parser::expression() {
+Node *Parser::expression() {
 	return assign();
 }
-std::unique_ptr<Node> Parser::assign() {
+Node *Parser::assign() {
 	auto node = equation();
 
 	if (consume("=")) {
-		node = new_node(Node::node_type::assign, std::move(node), assign());
+		node = new_node(Node::node_type::assign, node, assign());
 	}
 
 	return node;
 }
-std::unique_ptr<Node> Parser::equation() {
+Node *Parser::equation() {
 	auto node = comparison();
 
 	while (1) {
 		if (consume("==")) {
-			node = new_node(Node::node_type::equal, std::move(node), comparison());
+			node = new_node(Node::node_type::equal, node, comparison());
 		} else if (consume("!=")) {
-			node =
-			    new_node(Node::node_type::not_equal, std::move(node), comparison());
+			node = new_node(Node::node_type::not_equal, node, comparison());
 		} else {
 			return node;
 		}
 	}
 }
-std::unique_ptr<Node> Parser::comparison() {
+Node *Parser::comparison() {
 	auto node = add();
 
 	while (1) {
 		if (consume(">=")) {
-			node = new_node(Node::node_type::greater_equal, std::move(node), add());
+			node = new_node(Node::node_type::greater_equal, node, add());
 		} else if (consume("<=")) {
-			node = new_node(Node::node_type::less_equal, std::move(node), add());
+			node = new_node(Node::node_type::less_equal, node, add());
 		} else if (consume(">")) {
-			node = new_node(Node::node_type::greater, std::move(node), add());
+			node = new_node(Node::node_type::greater, node, add());
 		} else if (consume("<")) {
-			node = new_node(Node::node_type::less, std::move(node), add());
+			node = new_node(Node::node_type::less, node, add());
 		} else {
 			return node;
 		}
 	}
 }
-std::unique_ptr<Node> Parser::add() {
+Node *Parser::add() {
 	auto node = mul();
 
 	while (1) {
 		if (consume("+")) {
-			node = new_node(Node::node_type::addition, std::move(node), mul());
+			node = new_node(Node::node_type::addition, node, mul());
 		} else if (consume("-")) {
-			node = new_node(Node::node_type::subtraction, std::move(node), mul());
+			node = new_node(Node::node_type::subtraction, node, mul());
 		} else {
 			return node;
 		}
 	}
 }
-std::unique_ptr<Node> Parser::mul() {
+Node *Parser::mul() {
 	auto node = sign();
 
 	while (1) {
 		if (consume("*")) {
-			node = new_node(Node::node_type::multiplication, std::move(node), sign());
+			node = new_node(Node::node_type::multiplication, node, sign());
 		} else if (consume("/")) {
-			node = new_node(Node::node_type::division, std::move(node), sign());
+			node = new_node(Node::node_type::division, node, sign());
 		} else {
 			return node;
 		}
 	}
 }
-std::unique_ptr<Node> Parser::sign() {
+Node *Parser::sign() {
 	if (consume("+")) {
 		return new_node(Node::node_type::plus, sign());
 	}
@@ -303,7 +290,7 @@ std::unique_ptr<Node> Parser::sign() {
 	return address();
 }
 
-std::unique_ptr<Node> Parser::address() {
+Node *Parser::address() {
 	if (consume("*")) {
 		return new_node(Node::node_type::indirection, address());
 	}
@@ -313,7 +300,7 @@ std::unique_ptr<Node> Parser::address() {
 
 	return primary();
 }
-std::unique_ptr<Node> Parser::primary() {
+Node *Parser::primary() {
 	if (consume("(")) {
 		auto node = expression();
 		expect(")");
@@ -334,31 +321,32 @@ std::unique_ptr<Node> Parser::primary() {
 			return new_node(Node::node_type::identifier, identifier);
 		} else {
 			// function call
-			auto node = new_node(Node::node_type::call, identifier);
+			const auto arguments = begin_children();
 
 			// non-nullary function call
 			if (!consume(")")) {
-				node->child.push_back(expression());
+				pending_children.push_back(expression());
 				while (consume(",")) {
-					node->child.push_back(expression());
+					pending_children.push_back(expression());
 				}
 				expect(")");
 			}
 
-			return std::move(node);
+			return tree->new_node(Node::node_type::call, end_children(arguments),
+			                      identifier);
 		}
 	}
 	return new_node(Node::node_type::number, expect_number());
 }
 
-std::unique_ptr<Node> Parser::makeAST() {
-	auto AST = program();
+std::unique_ptr<SyntaxTree> Parser::makeAST() {
+	tree       = std::make_unique<SyntaxTree>();
+	tree->root = program();
 
 	if (!tokenListIsEmpty()) {
 		const auto &extra_token = getFrontToken();
-		error("extra character", extra_token.line, extra_token.line_num,
-		      extra_token.pos);
+		error("extra character", extra_token);
 	}
 
-	return AST;
+	return std::move(tree);
 }
@@ -1,106 +1,71 @@
 #ifndef INCLUDE_GUARD_PARSER_
 #define INCLUDE_GUARD_PARSER_
 
+#include "ast.h"
 #include "tokenizer.h"
+#include <cassert>
 #include <cstddef>
 #include <memory>
 #include <ostream>
-#include <queue>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
-struct Node {
-	enum class node_type {
-		function,       // function-definition
-		call,           // function-call
-		ifelse_,        // if-else
-		if_,            // if
-		for_,           // for
-		while_,         // while
-		statements,     // compound statements
-		empty,          // empty statement
-		return_,        // return
-		assign,         // =
-		equal,          // ==
-		not_equal,      // !=
-		greater_equal,  // >=
-		less_equal,     // <=
-		greater,        // >
-		less,           // <
-		addition,       // binary +
-		subtraction,    // binary -
-		multiplication, // binary *
-		division,       // /
-		plus,           // unary +
-		minus,          // unary -
-		address,        // unary &
-		indirection,    // unary *
-		number,         // unsigned integer literal
-		identifier      // identifier
-	};
-	node_type type;
-	Node(node_type type)
-	    : type(type) {}
-	Node(Node &&node)
-	    : type(std::move(node.type))
-	    , value(std::move(node.value)) {
-		child.reserve(node.child.size());
-		child.insert(child.end(), std::make_move_iterator(node.child.begin()),
-		             std::make_move_iterator(node.child.end()));
-		node.child.clear();
-	}
-
-	std::vector<std::unique_ptr<Node>> child;
-	std::vector<std::string>
-	            identifier_list; // type = function の時の、識別子リスト
-	std::string value;
-};
-
 class TokenManager {
 private:
-	std::list<Token> token_list;
-	Token            lastPoppedToken;
+	std::vector<Token>     owned_tokens; // used only when tokens are moved in
+	std::span<const Token> tokens;       // contiguous token stream
+	std::size_t            cursor = 0;   // index of the front token
+	// source text which tokens refer to (kept alive while parsing)
+	std::shared_ptr<const Source> source;
 
 public:
-	TokenManager(const TokenManager &tokenManager) {
-		this->token_list = tokenManager.token_list;
-	}
-	TokenManager(TokenManager &&tokenManager) noexcept {
-		this->token_list = std::move(tokenManager.token_list);
-	}
-	TokenManager(const std::list<Token> &token_list)
-	    : token_list(token_list) {}
-	TokenManager(std::list<Token> &&token_list)
-	    : token_list(std::move(token_list)) {}
-
-	Token &getFrontToken() {
-		return token_list.front();
+	TokenManager(const TokenManager &tokenManager) = delete;
+	TokenManager(TokenManager &&tokenManager) noexcept = default;
+	// tokens are not copied, so they must outlive this
+	TokenManager(std::span<const Token>                tokens,
+	             const std::shared_ptr<const Source> &source = nullptr)
+	    : tokens(tokens)
+	    , source(source) {}
+	TokenManager(std::vector<Token> &&                tokens,
+	             const std::shared_ptr<const Source> &source = nullptr)
+	    : owned_tokens(std::move(tokens))
+	    , tokens(owned_tokens)
+	    , source(source) {}
+
+	const Token &getFrontToken() const {
+		return tokens[cursor];
 	}
 	void popFrontToken() {
-		lastPoppedToken = getFrontToken();
-		token_list.pop_front();
+		++cursor;
 	}
-	const Token &getLastPoppedToken() {
-		return lastPoppedToken;
+	const Token &getLastPoppedToken() const {
+		assert(cursor != 0);
+		return tokens[cursor - 1];
 	}
-	bool tokenListIsEmpty() {
-		return token_list.empty();
+	bool tokenListIsEmpty() const {
+		return cursor == tokens.size();
 	}
 };
 class Parser : protected TokenManager {
 public:
+	// tokenizer must outlive this
 	Parser(const Tokenizer &tokenizer)
-	    : TokenManager(tokenizer.token_list) {}
+	    : TokenManager(std::span(tokenizer.token_list), tokenizer.source) {}
 	Parser(Tokenizer &&tokenizer)
-	    : TokenManager(std::move(tokenizer.token_list)) {}
-	Parser(const std::list<Token> &token_list)
-	    : TokenManager(token_list) {}
-	Parser(std::list<Token> &&token_list)
-	    : TokenManager(std::move(token_list)) {}
+	    : TokenManager(std::move(tokenizer.token_list), tokenizer.source) {}
+	// tokens must outlive this
+	Parser(std::span<const Token> tokens)
+	    : TokenManager(tokens) {}
+	Parser(std::vector<Token> &&tokens)
+	    : TokenManager(std::move(tokens)) {}
 
 private:
 	/* Abstract Syntax Tree*/
+	std::unique_ptr<SyntaxTree> tree; // tree being built
+	std::vector<Node *>         pending_children;
+
 private:
 	// if current token is expected op, then next token and return
 	// true else just return false
@@ -111,59 +76,58 @@ private:
 
 	// if current token is number, then next token and return the number
 	// else error
-	std::string expect_number();
+	Symbol expect_number();
 
 	// if current token is identifier, then next token and return the identifier
 	// else error
-	std::string expect_identifier();
+	Symbol expect_identifier();
 
 	/**
-	 * new terminal node
+	 * child lists are built in pending_children:
+	 * remember its size, push children and then move them into the tree
 	 */
-	std::unique_ptr<Node> new_node(Node::node_type    type,
-	                               const std::string &value);
-
-	void set_child_node(const std::unique_ptr<Node> &parent) const {
-		// 何もしない
-		// std::unique_ptr<Node> new_node(Node::node_type) 用
+	std::size_t begin_children() const {
+		return pending_children.size();
 	}
-	void set_child_node(const std::unique_ptr<Node> &parent,
-	                    std::unique_ptr<Node>        child) const {
-		parent->child.push_back(std::move(child));
+	NodeList end_children(std::size_t begin) {
+		auto list = tree->new_list(std::span(pending_children).subspan(begin));
+		pending_children.resize(begin);
+		return list;
 	}
 
-	template <typename... Rest>
-	void set_child_node(const std::unique_ptr<Node> &parent,
-	                    std::unique_ptr<Node> child, Rest... restChild) const {
-		parent->child.push_back(std::move(child));
-		set_child_node(parent, std::forward<Rest>(restChild)...);
+	/**
+	 * new terminal node
+	 */
+	Node *new_node(Node::node_type type, Symbol value) {
+		return tree->new_node(type, value);
 	}
 
-	template <typename... Rest>
-	[[nodiscard]] std::unique_ptr<Node> new_node(Node::node_type type,
-	                                             Rest... restChild) const {
-		std::unique_ptr<Node> node(new Node(type));
-		node->type = type;
-		set_child_node(node, std::forward<Rest>(restChild)...);
-		return node;
+	template <typename... Children>
+	[[nodiscard]] Node *new_node(Node::node_type type, Children... children) {
+		if constexpr (sizeof...(Children) == 0) {
+			return tree->new_node(type);
+		} else {
+			Node *const child_list[] = {children...};
+			return tree->new_node(type, child_list);
+		}
 	}
 
 	/* make nodes */
-	std::unique_ptr<Node> program();
-	std::unique_ptr<Node> function();
-	std::unique_ptr<Node> statement();
-	std::unique_ptr<Node> expression();
-	std::unique_ptr<Node> assign();
-	std::unique_ptr<Node> equation();
-	std::unique_ptr<Node> comparison();
-	std::unique_ptr<Node> add();
-	std::unique_ptr<Node> mul();
-	std::unique_ptr<Node> sign();
-	std::unique_ptr<Node> address();
-	std::unique_ptr<Node> primary();
+	Node *program();
+	Node *function();
+	Node *statement();
+	Node *expression();
+	Node *assign();
+	Node *equation();
+	Node *comparison();
+	Node *add();
+	Node *mul();
+	Node *sign();
+	Node *address();
+	Node *primary();
 
 public:
-	std::unique_ptr<Node> makeAST();
+	std::unique_ptr<SyntaxTree> makeAST();
 };
 
 #endif
@@ -0,0 +1,567 @@
+#include "peephole.h"
+#include <cassert>
+#include <limits>
+
+using opcode_type = Instruction::opcode_type;
+using kind_type   = Operand::kind_type;
+
+namespace {
+// レジスタの集合（ビット i がレジスタ i）
+using RegisterSet = std::uint32_t;
+
+constexpr RegisterSet bit(Register reg) {
+	return RegisterSet(1) << static_cast<unsigned>(reg);
+}
+
+constexpr RegisterSet argument_registers =
+    bit(Register::rdi) | bit(Register::rsi) | bit(Register::rdx) |
+    bit(Register::rcx) | bit(Register::r8) | bit(Register::r9);
+constexpr RegisterSet caller_saved = argument_registers | bit(Register::rax) |
+                                     bit(Register::r10) | bit(Register::r11);
+constexpr RegisterSet callee_saved =
+    bit(Register::rbx) | bit(Register::rsp) | bit(Register::rbp) |
+    bit(Register::r12) | bit(Register::r13) | bit(Register::r14) |
+    bit(Register::r15);
+
+// push した値を pop まで預けておくレジスタの候補（caller-saved）
+constexpr Register scratch_registers[] = {Register::rcx, Register::rsi,
+                                          Register::r8,  Register::r9,
+                                          Register::r10, Register::r11};
+
+// 生存解析で見る命令数の上限（それより先は生きているとみなす）
+constexpr std::size_t scan_limit = 64;
+
+// 命令が読み書きするもの
+struct Effect {
+	RegisterSet reads        = 0;
+	RegisterSet writes       = 0;
+	bool        reads_flags  = false;
+	bool        writes_flags = false;
+	bool        control      = false; // 基本ブロックの境界（ラベル、分岐など）
+};
+
+// 関数から出る命令（ret か末尾呼び出しの jmp）
+bool leaves_function(const Instruction &instruction) {
+	return opcode_type::ret == instruction.opcode ||
+	       (opcode_type::jmp == instruction.opcode &&
+	        kind_type::symbol == instruction.dst.kind);
+}
+
+bool fits_int32(std::int64_t value) {
+	return std::numeric_limits<std::int32_t>::min() <= value &&
+	       value <= std::numeric_limits<std::int32_t>::max();
+}
+bool is_register(const Operand &operand, Register reg) {
+	return kind_type::reg == operand.kind && reg == operand.base;
+}
+// operand の値を得るのに読むレジスタ
+RegisterSet read_set(const Operand &operand) {
+	switch (operand.kind) {
+	case kind_type::reg:
+	case kind_type::reg8:
+	case kind_type::mem:
+		return bit(operand.base);
+	default:
+		return 0;
+	}
+}
+// operand がメモリならアドレスに使うレジスタ
+RegisterSet address_set(const Operand &operand) {
+	return kind_type::mem == operand.kind ? bit(operand.base) : 0;
+}
+// operand に書き込むレジスタ
+RegisterSet write_set(const Operand &operand) {
+	return kind_type::reg == operand.kind || kind_type::reg8 == operand.kind
+	           ? bit(operand.base)
+	           : 0;
+}
+
+Effect effect(const Instruction &instruction) {
+	const auto &dst = instruction.dst;
+	const auto &src = instruction.src;
+
+	Effect effect;
+	switch (instruction.opcode) {
+	case opcode_type::mov:
+	case opcode_type::movzx:
+		effect.reads  = read_set(src) | address_set(dst);
+		effect.writes = write_set(dst);
+		break;
+	case opcode_type::lea:
+		effect.reads  = address_set(src);
+		effect.writes = write_set(dst);
+		break;
+	case opcode_type::push:
+		effect.reads  = read_set(dst) | bit(Register::rsp);
+		effect.writes = bit(Register::rsp);
+		break;
+	case opcode_type::pop:
+		effect.reads  = address_set(dst) | bit(Register::rsp);
+		effect.writes = write_set(dst) | bit(Register::rsp);
+		break;
+	case opcode_type::add:
+	case opcode_type::sub:
+	case opcode_type::imul:
+	case opcode_type::neg:
+	case opcode_type::shl:
+	case opcode_type::sar:
+	case opcode_type::shr:
+		effect.reads        = read_set(dst) | read_set(src);
+		effect.writes       = write_set(dst);
+		effect.writes_flags = true;
+		break;
+	case opcode_type::imul_high:
+		effect.reads        = bit(Register::rax) | read_set(dst);
+		effect.writes       = bit(Register::rax) | bit(Register::rdx);
+		effect.writes_flags = true;
+		break;
+	case opcode_type::cmp:
+	case opcode_type::test:
+		effect.reads        = read_set(dst) | read_set(src);
+		effect.writes_flags = true;
+		break;
+	case opcode_type::cqo:
+		effect.reads  = bit(Register::rax);
+		effect.writes = bit(Register::rdx);
+		break;
+	case opcode_type::idiv:
+		effect.reads  = bit(Register::rax) | bit(Register::rdx) | read_set(dst);
+		effect.writes = bit(Register::rax) | bit(Register::rdx);
+		effect.writes_flags = true;
+		break;
+	case opcode_type::set:
+		// 下位 8 bit だけ書くので、残りは読んだことになる
+		effect.reads       = read_set(dst);
+		effect.writes      = write_set(dst);
+		effect.reads_flags = true;
+		break;
+	case opcode_type::jcc:
+		effect.reads_flags = true;
+		effect.control     = true;
+		break;
+	case opcode_type::call:
+		effect.reads        = argument_registers | bit(Register::rsp);
+		effect.writes       = caller_saved;
+		effect.writes_flags = true;
+		effect.control      = true;
+		break;
+	case opcode_type::ret:
+		effect.reads   = bit(Register::rax) | callee_saved;
+		effect.control = true;
+		break;
+	case opcode_type::jmp:
+		if (kind_type::symbol == dst.kind) {
+			// 末尾呼び出し
+			effect.reads = argument_registers | callee_saved;
+		}
+		effect.control = true;
+		break;
+	case opcode_type::label:
+	case opcode_type::function:
+		effect.control = true;
+		break;
+	}
+	return effect;
+}
+
+/**
+ * 関数ごとの命令列に規則を繰り返し適用する
+ * 削除した命令は removed で印を付けておき、1 巡ごとに詰める
+ */
+class Peephole {
+private:
+	std::vector<Instruction> &code;
+	std::vector<bool>         removed;
+	bool                      changed = false;
+
+	// index より後で削除されていない最初の命令（なければ code.size()）
+	std::size_t next(std::size_t index) const {
+		do {
+			++index;
+		} while (index < code.size() && removed[index]);
+		return index;
+	}
+	void remove(std::size_t index) {
+		removed[index] = true;
+		changed        = true;
+	}
+	void replace(std::size_t index, Instruction instruction) {
+		code[index] = instruction;
+		changed     = true;
+	}
+
+	// from 以降で reg の値が読まれないか
+	bool is_dead(Register reg, std::size_t from) const {
+		std::size_t count = 0;
+		for (auto i = from; i < code.size() && count < scan_limit;
+		     i = next(i), ++count) {
+			const auto e = effect(code[i]);
+			if (e.reads & bit(reg)) {
+				return false;
+			}
+			if (e.writes & bit(reg)) {
+				return true;
+			}
+			if (leaves_function(code[i])) {
+				return true; // 戻り値、実引数と callee-saved 以外は使われない
+			}
+			if (e.control && opcode_type::call != code[i].opcode) {
+				return false;
+			}
+		}
+		return false;
+	}
+	// from 以降でフラグが読まれないか
+	bool flags_dead(std::size_t from) const {
+		std::size_t count = 0;
+		for (auto i = from; i < code.size() && count < scan_limit;
+		     i = next(i), ++count) {
+			const auto e = effect(code[i]);
+			if (e.reads_flags) {
+				return false;
+			}
+			if (e.writes_flags || leaves_function(code[i])) {
+				return true;
+			}
+			if (e.control) {
+				return false;
+			}
+		}
+		return false;
+	}
+
+	bool unreachable(std::size_t i);
+	bool jump_to_next(std::size_t i);
+	bool push_pop(std::size_t i);
+	bool address(std::size_t i);
+	bool fold_address(std::size_t i);
+	bool forward_move(std::size_t i);
+	bool dead_move(std::size_t i);
+	bool move_back(std::size_t i);
+	bool store_load(std::size_t i);
+
+public:
+	explicit Peephole(std::vector<Instruction> &code)
+	    : code(code) {}
+
+	void run();
+};
+} // namespace
+
+// jmp, ret の後はラベルまで実行されない
+bool Peephole::unreachable(std::size_t i) {
+	const auto opcode = code[i].opcode;
+	if (opcode_type::jmp != opcode && opcode_type::ret != opcode) {
+		return false;
+	}
+	bool found = false;
+	for (auto j = next(i); j < code.size(); j = next(j)) {
+		if (opcode_type::label == code[j].opcode ||
+		    opcode_type::function == code[j].opcode) {
+			break;
+		}
+		remove(j);
+		found = true;
+	}
+	return found;
+}
+
+// jmp L; L: の jmp は不要
+bool Peephole::jump_to_next(std::size_t i) {
+	const auto j = next(i);
+	if (opcode_type::jmp != code[i].opcode || j == code.size() ||
+	    kind_type::label != code[i].dst.kind ||
+	    opcode_type::label != code[j].opcode ||
+	    code[i].dst.label != code[j].dst.label) {
+		return false;
+	}
+	remove(i);
+	return true;
+}
+
+/**
+ * push X ... pop Y を mov Y, X にする
+ * 間の命令はスタックに触れず、分岐もしないものに限る
+ * 間で X が書き換わる場合は、空いているレジスタに預ける
+ */
+bool Peephole::push_pop(std::size_t i) {
+	const auto &push = code[i];
+	if (opcode_type::push != push.opcode) {
+		return false;
+	}
+
+	RegisterSet between = 0; // 間の命令が読み書きするレジスタ
+	auto        k       = next(i);
+	for (; k < code.size(); k = next(k)) {
+		const auto e = effect(code[k]);
+		if ((e.reads | e.writes) & bit(Register::rsp) || e.control) {
+			break;
+		}
+		between |= e.reads | e.writes;
+	}
+	if (k == code.size() || opcode_type::pop != code[k].opcode ||
+	    kind_type::reg != code[k].dst.kind) {
+		return false;
+	}
+	const auto value  = push.dst;
+	const auto target = code[k].dst.base;
+
+	if (kind_type::imm == value.kind ||
+	    !(between & bit(value.base))) { // X がそのまま残っている
+		remove(i);
+		if (is_register(value, target)) {
+			remove(k);
+		} else {
+			replace(k, Instruction{opcode_type::mov, Condition::e, target, value});
+		}
+		return true;
+	}
+
+	for (const auto scratch : scratch_registers) {
+		if (!(between & bit(scratch)) && scratch != target &&
+		    is_dead(scratch, next(k))) {
+			replace(i, Instruction{opcode_type::mov, Condition::e, scratch, value});
+			replace(k,
+			        Instruction{opcode_type::mov, Condition::e, target, scratch});
+			return true;
+		}
+	}
+	return false;
+}
+
+// mov R, rbp; sub R, N を lea R, [rbp-N] にする
+bool Peephole::address(std::size_t i) {
+	const auto  j   = next(i);
+	const auto &mov = code[i];
+	if (opcode_type::mov != mov.opcode || kind_type::reg != mov.dst.kind ||
+	    !is_register(mov.src, Register::rbp) || j == code.size()) {
+		return false;
+	}
+	const auto &sub = code[j];
+	if (opcode_type::sub != sub.opcode || !is_register(sub.dst, mov.dst.base) ||
+	    kind_type::imm != sub.src.kind || !fits_int32(-sub.src.imm) ||
+	    !flags_dead(next(j))) {
+		return false;
+	}
+	replace(i, Instruction{opcode_type::lea, Condition::e, mov.dst.base,
+	                       memory(Register::rbp,
+	                              static_cast<std::int32_t>(-sub.src.imm))});
+	remove(j);
+	return true;
+}
+
+// lea R, [B+d]; op ..., [R+e] を op ..., [B+d+e] にする（R がその後不要なら）
+bool Peephole::fold_address(std::size_t i) {
+	const auto &lea = code[i];
+	const auto  j   = next(i);
+	if (opcode_type::lea != lea.opcode || j == code.size()) {
+		return false;
+	}
+	const auto reg = lea.dst.base;
+
+	auto user = code[j];
+	switch (user.opcode) {
+	case opcode_type::mov:
+	case opcode_type::movzx:
+	case opcode_type::lea:
+	case opcode_type::add:
+	case opcode_type::sub:
+	case opcode_type::imul:
+	case opcode_type::cmp:
+		break;
+	default:
+		return false;
+	}
+
+	Operand *use = nullptr;
+	if (kind_type::mem == user.dst.kind && reg == user.dst.base) {
+		use = &user.dst;
+	} else if (kind_type::mem == user.src.kind && reg == user.src.base) {
+		use = &user.src;
+	} else {
+		return false;
+	}
+	const std::int64_t disp =
+	    static_cast<std::int64_t>(lea.src.disp) + use->disp;
+	if (!fits_int32(disp)) {
+		return false;
+	}
+	*use = memory(lea.src.base, static_cast<std::int32_t>(disp));
+
+	// R を他で読まず、R の値がその後も要らないこと
+	const auto e = effect(user);
+	if ((e.reads & bit(reg)) ||
+	    (!(e.writes & bit(reg)) && !is_dead(reg, next(j)))) {
+		return false;
+	}
+	replace(j, user);
+	remove(i);
+	return true;
+}
+
+/**
+ * mov R, S の直後で R を 1 度だけ使うなら、S を直接使う
+ * (mov D, R / push R / add, sub, cmp D, R / imul D, R)
+ */
+bool Peephole::forward_move(std::size_t i) {
+	const auto &mov = code[i];
+	const auto  j   = next(i);
+	if (opcode_type::mov != mov.opcode || kind_type::reg != mov.dst.kind ||
+	    j == code.size() || !is_register(code[j].src.kind == kind_type::none
+	                                         ? code[j].dst
+	                                         : code[j].src,
+	                                     mov.dst.base)) {
+		return false;
+	}
+	const auto reg    = mov.dst.base;
+	const auto source = mov.src;
+	auto       user   = code[j];
+	if ((address_set(user.dst) & bit(reg)) ||
+	    (opcode_type::push != user.opcode && is_register(user.dst, reg))) {
+		return false;
+	}
+	const bool small_imm = kind_type::imm == source.kind && fits_int32(source.imm);
+
+	switch (user.opcode) {
+	case opcode_type::mov:
+		if (kind_type::mem == user.dst.kind &&
+		    (kind_type::mem == source.kind ||
+		     (kind_type::imm == source.kind && !small_imm))) {
+			return false;
+		}
+		user.src = source;
+		break;
+	case opcode_type::push:
+		if (kind_type::reg != source.kind && !small_imm) {
+			return false;
+		}
+		user.dst = source;
+		break;
+	case opcode_type::add:
+	case opcode_type::sub:
+	case opcode_type::cmp:
+		if (!small_imm && kind_type::reg != source.kind) {
+			return false;
+		}
+		user.src = source;
+		break;
+	case opcode_type::imul:
+		if (kind_type::reg != source.kind && kind_type::mem != source.kind) {
+			return false;
+		}
+		user.src = source;
+		break;
+	default:
+		return false;
+	}
+	if (!is_dead(reg, next(j))) {
+		return false;
+	}
+
+	replace(j, user);
+	remove(i);
+	return true;
+}
+
+// 値が使われないレジスタへの mov, movzx, lea を消す
+bool Peephole::dead_move(std::size_t i) {
+	const auto &instruction = code[i];
+	switch (instruction.opcode) {
+	case opcode_type::mov:
+	case opcode_type::movzx:
+	case opcode_type::lea:
+		break;
+	default:
+		return false;
+	}
+	if (kind_type::reg != instruction.dst.kind) {
+		return false;
+	}
+	if (is_register(instruction.src, instruction.dst.base) &&
+	    opcode_type::mov == instruction.opcode) {
+		remove(i); // mov R, R
+		return true;
+	}
+	const auto reg = instruction.dst.base;
+	if (Register::rsp == reg || Register::rbp == reg ||
+	    !is_dead(reg, next(i))) {
+		return false;
+	}
+	remove(i);
+	return true;
+}
+
+// mov A, B; ...; mov B, A の後の方は（間で A も B も変わらなければ）不要
+bool Peephole::move_back(std::size_t i) {
+	const auto &mov = code[i];
+	if (opcode_type::mov != mov.opcode || kind_type::reg != mov.dst.kind ||
+	    kind_type::reg != mov.src.kind) {
+		return false;
+	}
+	const auto  both  = bit(mov.dst.base) | bit(mov.src.base);
+	std::size_t count = 0;
+	for (auto k = next(i); k < code.size() && count < scan_limit;
+	     k = next(k), ++count) {
+		const auto &instruction = code[k];
+		if (opcode_type::mov == instruction.opcode &&
+		    is_register(instruction.dst, mov.src.base) &&
+		    is_register(instruction.src, mov.dst.base)) {
+			remove(k);
+			return true;
+		}
+		const auto e = effect(instruction);
+		if ((e.writes & both) || e.control) {
+			return false;
+		}
+	}
+	return false;
+}
+
+// mov [M], R; mov S, [M] の後の方は mov S, R でよい
+bool Peephole::store_load(std::size_t i) {
+	const auto &store = code[i];
+	if (opcode_type::mov != store.opcode || kind_type::mem != store.dst.kind ||
+	    kind_type::reg != store.src.kind) {
+		return false;
+	}
+	const auto k = next(i);
+	if (k == code.size()) {
+		return false;
+	}
+	auto &load = code[k];
+	if (opcode_type::mov != load.opcode || kind_type::reg != load.dst.kind ||
+	    kind_type::mem != load.src.kind || load.src.base != store.dst.base ||
+	    load.src.disp != store.dst.disp) {
+		return false;
+	}
+	load.src = store.src;
+	changed  = true;
+	return true;
+}
+
+void Peephole::run() {
+	do {
+		changed = false;
+		removed.assign(code.size(), false);
+		for (std::size_t i = 0; i < code.size(); i = next(i)) {
+			if (removed[i]) {
+				continue;
+			}
+			unreachable(i) || jump_to_next(i) || push_pop(i) || address(i) ||
+			    fold_address(i) || forward_move(i) || dead_move(i) ||
+			    move_back(i) || store_load(i);
+		}
+
+		std::size_t size = 0;
+		for (std::size_t i = 0; i < code.size(); ++i) {
+			if (!removed[i]) {
+				code[size++] = code[i];
+			}
+		}
+		code.resize(size);
+	} while (changed);
+}
+
+void optimize_peephole(Assembly &assembly) {
+	Peephole(assembly.instructions).run();
+}
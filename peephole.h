@@ -0,0 +1,15 @@
+#ifndef INCLUDE_GUARD_PEEPHOLE_
+#define INCLUDE_GUARD_PEEPHOLE_
+
+#include "assembly.h"
+
+/**
+ * peephole optimization of the instruction list of functions
+ * removes the push/pop traffic of the stack machine codegen
+ * (pairs become register moves), folds "rbp - N" address computations into
+ * [rbp-N] operands, forwards a stored register to the load right after it,
+ * and drops dead moves and unreachable code
+ */
+void optimize_peephole(Assembly &assembly);
+
+#endif
@@ -1,14 +1,15 @@
 #include "print.h"
+#include "error.h"
 #include <cassert>
 #include <iostream>
 
 std::ostream &operator<<(std::ostream &stream, const Tokenizer &tokenizer) {
-	return stream << tokenizer.token_list;
+	return stream << std::span(tokenizer.token_list);
 }
-std::ostream &operator<<(std::ostream &stream, std::list<Token> token_list) {
-	while (!token_list.empty()) {
-		stream << std::move(token_list.front().value) << "\n";
-		token_list.pop_front();
+std::ostream &operator<<(std::ostream &         stream,
+                         std::span<const Token> token_list) {
+	for (const auto &token : token_list) {
+		stream << token.value << "\n";
 	}
 
 	return stream;
@@ -34,9 +35,9 @@ std::ostream &operator<<(std::ostream &stream, const Node &node) {
 		assert(node.child[0]->type == Node::node_type::statements);
 
 		stream << node.value << "(";
-		for (auto begin    = node.identifier_list.begin(),
-		          ident_it = node.identifier_list.begin(),
-		          end      = node.identifier_list.end();
+		const auto parameters = node.parameters();
+		for (auto begin = parameters.begin(), ident_it = parameters.begin(),
+		          end = parameters.end();
 		     end != ident_it; ++ident_it) {
 			if (begin != ident_it) {
 				stream << ", ";
@@ -300,6 +301,12 @@ std::ostream &operator<<(std::ostream &stream, const Node &node) {
 		return stream;
 	}
 
+	// empty statement
+	if (Node::node_type::empty == node.type) {
+		stream << std::string(2 * depth, ' ') << ";" << std::endl;
+		return stream;
+	}
+
 	// statements
 	if (Node::node_type::statements == node.type) {
 		for (const auto &child : node.child) {
@@ -309,7 +316,6 @@ std::ostream &operator<<(std::ostream &stream, const Node &node) {
 		return stream;
 	}
 
-	std::cerr << "Invalid type(" << static_cast<int>(node.type)
-	          << ") detected when print." << std::endl;
-	std::exit(EXIT_FAILURE);
+	error("Invalid type(" + std::to_string(static_cast<int>(node.type)) +
+	      ") detected when print.");
 }
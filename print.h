@@ -4,7 +4,8 @@
 #include "parser.h"
 #include "tokenizer.h"
 std::ostream &operator<<(std::ostream &stream, const Tokenizer &tokenizer);
-std::ostream &operator<<(std::ostream &stream, std::list<Token> token_list);
+std::ostream &operator<<(std::ostream &         stream,
+                         std::span<const Token> token_list);
 std::ostream &operator<<(std::ostream &stream, const Node &node);
 
 #endif
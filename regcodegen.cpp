@@ -0,0 +1,519 @@
+#include "regcodegen.h"
+#include "error.h"
+#include "fold.h"
+#include "licm.h"
+#include "strength.h"
+#include "symbol_table.h"
+#include "tailcall.h"
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+/**
+ * 式の一時値を置くレジスタ
+ * callee-saved なので call を跨いでも値が残る
+ * 深さ d の一時値は registers[d % register_count] に置き、
+ * d >= register_count の時だけ以前の値をスタックに退避する
+ */
+static constexpr Register    registers[]    = {Register::rbx, Register::r12,
+                                            Register::r13, Register::r14,
+                                            Register::r15};
+static constexpr std::size_t register_count =
+    sizeof(registers) / sizeof(*registers);
+
+// 引数に対応するレジスタ
+static constexpr Register argument_registers[] = {
+    Register::rdi, Register::rsi, Register::rdx,
+    Register::rcx, Register::r8,  Register::r9};
+
+namespace {
+/**
+ * 生成中の関数の状態
+ * 関数ごとに独立しているので、関数単位で並列に生成できる
+ */
+struct FunctionState {
+	Assembly     &out;
+	const Node   &function;
+	Symbol        name;
+	SymbolTable   symbol_table; // ローカル変数
+	std::size_t   depth_count;  // 使用した一時値の深さの数
+	Label         return_label; // エピローグのラベル
+	std::uint32_t label_number; // 関数内のラベルの通し番号
+	// 末尾位置の呼び出し（フレームを畳んで jmp する）
+	std::unordered_set<const Node *> tail_calls;
+	Label recursion_label; // 自分自身の末尾呼び出しの飛び先（仮引数の格納）
+	bool  recursive = false;
+	// 末尾呼び出しの jmp の位置（退避したレジスタの復元を後で前に入れる）
+	std::vector<std::size_t> tail_jumps;
+	InvariantSlots invariants; // ループの前で計算しておくループ不変式
+
+	Label new_label(std::string_view kind, std::uint32_t number) {
+		return out.new_label(name, kind, number);
+	}
+};
+} // namespace
+
+static Register reg(std::size_t depth, FunctionState &state) {
+	state.depth_count = std::max(state.depth_count, depth + 1);
+	return registers[depth % register_count];
+}
+
+/**
+ * 深さ depth の一時値を使い始める
+ * レジスタが足りなければ、そのレジスタの以前の値をスタックに退避する
+ */
+static void acquire(std::size_t depth, FunctionState &state) {
+	if (depth >= register_count) {
+		state.out.push(reg(depth, state));
+	}
+}
+
+/**
+ * 深さ depth の一時値を使い終える
+ * acquire で退避した値があれば復元する
+ */
+static void release(std::size_t depth, FunctionState &state) {
+	if (depth >= register_count) {
+		state.out.pop(reg(depth, state));
+	}
+}
+
+/**
+ * identifier のスタック上の位置（[rbp-オフセット]）を返す
+ * なければエラー
+ */
+static Operand local_variable(Symbol identifier, const FunctionState &state) {
+	return memory(Register::rbp, -static_cast<std::int32_t>(
+	                                 state.symbol_table.offset(identifier)));
+}
+
+static void gen_statement(const Node &node, FunctionState &state);
+
+/**
+ * node を計算して、結果を深さ depth のレジスタに置く
+ */
+static void gen_expression(const Node &node, std::size_t depth,
+                           FunctionState &state) {
+	auto      &out = state.out;
+	const auto dst = reg(depth, state);
+
+	if (const auto slot = state.invariants.slot(node)) {
+		out.mov(dst, *slot);
+		return;
+	}
+
+	switch (node.type) {
+	case Node::node_type::number:
+		assert(node.child.empty());
+		out.mov(dst, number_value(node.value));
+		return;
+
+	case Node::node_type::identifier:
+		assert(node.child.empty());
+		out.mov(dst, local_variable(node.value, state));
+		return;
+
+	case Node::node_type::assign:
+		assert(node.child.size() == 2);
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		gen_expression(*node.child[1], depth, state);
+		out.mov(local_variable(node.child[0]->value, state), dst);
+		return;
+
+	case Node::node_type::address:
+		assert(node.child.size() == 1);
+		assert(node.child[0]->type == Node::node_type::identifier);
+
+		out.lea(dst, local_variable(node.child[0]->value, state));
+		return;
+
+	case Node::node_type::indirection:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], depth, state);
+		out.mov(dst, memory(dst));
+		return;
+
+	case Node::node_type::plus:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], depth, state);
+		return;
+
+	case Node::node_type::minus:
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], depth, state);
+		out.neg(dst);
+		return;
+
+	case Node::node_type::call: {
+		if (node.child.size() > std::size(argument_registers)) {
+			error("too many arguments to " + std::string(node.value.str()));
+		}
+
+		/* 実引数を左から順に深さ depth, depth + 1, ... に計算 */
+		for (std::size_t i = 0; i < node.child.size(); ++i) {
+			if (i != 0) {
+				acquire(depth + i, state);
+			}
+			gen_expression(*node.child[i], depth + i, state);
+		}
+
+		/* 右から順に引数レジスタへ移す（退避した値は release で戻る）*/
+		for (std::size_t i = node.child.size(); i-- > 0;) {
+			out.mov(argument_registers[i], reg(depth + i, state));
+			if (i != 0) {
+				release(depth + i, state);
+			}
+		}
+
+		if (state.tail_calls.contains(&node)) {
+			if (is_self_tail_call(state.function, node)) {
+				// 自分自身なら、実引数を仮引数に入れ直して先頭から繰り返す
+				state.recursive = true;
+				out.jmp(state.recursion_label);
+			} else {
+				state.tail_jumps.push_back(out.instructions.size());
+				out.jmp(node.value);
+			}
+			return;
+		}
+		out.call(node.value);
+		out.mov(dst, Register::rax);
+		return;
+	}
+
+	case Node::node_type::multiplication:
+	case Node::node_type::division:
+		if (const auto constant = constant_operand(node)) {
+			gen_expression(*node.child[constant == node.child[0] ? 1 : 0], depth,
+			               state);
+
+			const auto value = number_value(constant->value);
+			if (Node::node_type::multiplication == node.type) {
+				if (!gen_multiply_constant(out, dst, Register::rax, value)) {
+					out.mov(Register::rax, value);
+					out.imul(dst, Register::rax);
+				}
+				return;
+			}
+			out.mov(Register::rax, dst);
+			if (!gen_divide_constant(out, value, Register::rcx)) {
+				out.mov(Register::rcx, value);
+				out.cqo();
+				out.idiv(Register::rcx);
+			}
+			out.mov(dst, Register::rax);
+			return;
+		}
+		[[fallthrough]];
+	case Node::node_type::equal:
+	case Node::node_type::not_equal:
+	case Node::node_type::greater_equal:
+	case Node::node_type::less_equal:
+	case Node::node_type::greater:
+	case Node::node_type::less:
+	case Node::node_type::addition:
+	case Node::node_type::subtraction: {
+		assert(node.child.size() == 2);
+
+		gen_expression(*node.child[0], depth, state);
+		acquire(depth + 1, state);
+		gen_expression(*node.child[1], depth + 1, state);
+		const auto src = reg(depth + 1, state);
+
+		std::optional<Condition> condition;
+		switch (node.type) {
+		case Node::node_type::equal:
+			condition = Condition::e;
+			break;
+		case Node::node_type::not_equal:
+			condition = Condition::ne;
+			break;
+		case Node::node_type::greater_equal:
+			condition = Condition::ge;
+			break;
+		case Node::node_type::less_equal:
+			condition = Condition::le;
+			break;
+		case Node::node_type::greater:
+			condition = Condition::g;
+			break;
+		case Node::node_type::less:
+			condition = Condition::l;
+			break;
+		case Node::node_type::addition:
+			out.add(dst, src);
+			break;
+		case Node::node_type::subtraction:
+			out.sub(dst, src);
+			break;
+		case Node::node_type::multiplication:
+			out.imul(dst, src);
+			break;
+		case Node::node_type::division:
+			out.mov(Register::rax, dst);
+			out.cqo();
+			out.idiv(src);
+			out.mov(dst, Register::rax);
+			break;
+		default:
+			assert(false);
+		}
+		if (condition) {
+			out.cmp(dst, src);
+			out.set(*condition, byte(dst));
+			out.movzx(dst, byte(dst));
+		}
+
+		release(depth + 1, state);
+		return;
+	}
+
+	default:
+		error("not implemented type(" +
+		      std::to_string(static_cast<int>(node.type)) +
+		      ") on register codegen");
+	}
+}
+
+/**
+ * 条件式 condition の真偽が value なら label に飛ぶ
+ * 比較なら 0/1 を作らずに cmp と jcc にする（右辺が小さい定数なら即値で比較）
+ */
+static void gen_branch(const Node &condition, bool value, Label label,
+                       FunctionState &state) {
+	auto      &out  = state.out;
+	const auto left = reg(0, state);
+
+	const auto holds = comparison(condition);
+	if (!holds || state.invariants.slot(condition)) {
+		gen_expression(condition, 0, state);
+		out.test(left, left);
+		out.j(value ? Condition::ne : Condition::e, label);
+		return;
+	}
+
+	assert(condition.child.size() == 2);
+	gen_expression(*condition.child[0], 0, state);
+	const auto &right = *condition.child[1];
+	if (Node::node_type::number == right.type &&
+	    std::in_range<std::int32_t>(number_value(right.value))) {
+		out.cmp(left, number_value(right.value));
+	} else {
+		acquire(1, state);
+		gen_expression(right, 1, state);
+		out.cmp(left, reg(1, state));
+		release(1, state);
+	}
+	out.j(value ? *holds : negate(*holds), label);
+}
+
+/**
+ * ループ loop の前で、その不変式をスロットに計算する
+ * （for なら初期化式の後）
+ */
+static void gen_preheader(const Node &loop, FunctionState &state) {
+	state.invariants.gen_preheader(loop, state.out, [&](const Node &invariant) {
+		gen_expression(invariant, 0, state);
+		return reg(0, state);
+	});
+}
+
+static void gen_statement(const Node &node, FunctionState &state) {
+	auto &out = state.out;
+
+	// if-else
+	if (Node::node_type::ifelse_ == node.type) {
+		const auto number    = state.label_number++;
+		const auto elselabel = state.new_label("ifelseelse", number);
+		const auto endlabel  = state.new_label("ifelseend", number);
+
+		assert(node.child.size() == 3);
+
+		gen_branch(*node.child[0], false, elselabel, state);
+		gen_statement(*node.child[1], state);
+		out.jmp(endlabel);
+		out.bind(elselabel);
+		gen_statement(*node.child[2], state);
+		out.bind(endlabel);
+		return;
+	}
+
+	// if
+	if (Node::node_type::if_ == node.type) {
+		const auto number = state.label_number++;
+		const auto label  = state.new_label("ifend", number);
+
+		assert(node.child.size() == 2);
+
+		gen_branch(*node.child[0], false, label, state);
+		gen_statement(*node.child[1], state);
+		out.bind(label);
+		return;
+	}
+
+	// while
+	if (Node::node_type::while_ == node.type) {
+		const auto number     = state.label_number++;
+		const auto beginlabel = state.new_label("whilebegin", number);
+		const auto endlabel   = state.new_label("whileend", number);
+
+		assert(node.child.size() == 2);
+
+		// 条件式を先頭（1 回目）と末尾に置き、1 周あたりの分岐を 1 回にする
+		gen_preheader(node, state);
+		const bool always = is_constant_true(*node.child[0]);
+		if (!always) {
+			gen_branch(*node.child[0], false, endlabel, state);
+		}
+		out.bind(beginlabel);
+		gen_statement(*node.child[1], state);
+		if (always) {
+			out.jmp(beginlabel);
+		} else {
+			gen_branch(*node.child[0], true, beginlabel, state);
+		}
+		out.bind(endlabel);
+		return;
+	}
+
+	// for
+	if (Node::node_type::for_ == node.type) {
+		const auto number     = state.label_number++;
+		const auto beginlabel = state.new_label("forbegin", number);
+		const auto endlabel   = state.new_label("forend", number);
+
+		assert(node.child.size() == 4);
+
+		gen_statement(*node.child[0], state); // 初期化式
+		gen_preheader(node, state);
+		const bool always = is_constant_true(*node.child[1]);
+		if (!always) {
+			gen_branch(*node.child[1], false, endlabel, state); // 条件式
+		}
+		out.bind(beginlabel);
+		gen_statement(*node.child[3], state); // 文
+		gen_statement(*node.child[2], state); // 変化式
+		if (always) {
+			out.jmp(beginlabel);
+		} else {
+			gen_branch(*node.child[1], true, beginlabel, state); // 条件式
+		}
+		out.bind(endlabel);
+		return;
+	}
+
+	// return
+	if (Node::node_type::return_ == node.type) {
+		assert(node.child.size() == 1);
+
+		gen_expression(*node.child[0], 0, state);
+		out.mov(Register::rax, reg(0, state));
+		out.jmp(state.return_label);
+		return;
+	}
+
+	// statements
+	if (Node::node_type::statements == node.type) {
+		state.symbol_table.enter_block(node);
+		for (const auto &child : node.child) {
+			gen_statement(*child, state);
+		}
+		state.symbol_table.leave_block();
+		return;
+	}
+
+	// empty statement
+	if (Node::node_type::empty == node.type) {
+		return;
+	}
+
+	// expression statement
+	// 関数の末尾に return が無い場合の戻り値になるので rax にも置く
+	gen_expression(node, 0, state);
+	out.mov(Register::rax, reg(0, state));
+}
+
+void gen_register_function(const Node &node, Assembly &out) {
+	assert(Node::node_type::function == node.type);
+	assert(node.child.size() == 1);
+	if (node.parameters().size() > std::size(argument_registers)) {
+		error("too many parameters of " + std::string(node.value.str()));
+	}
+
+	/* 仮引数とローカル変数の登録 */
+	FunctionState state{out, node, node.value, SymbolTable(node), 0, {}, 0,
+	                    find_tail_calls(node)};
+	state.return_label    = state.new_label("return", 0);
+	state.recursion_label = state.new_label("recursion", 0);
+
+	// ループ不変式は変数の後ろのスロットに置く
+	state.invariants = InvariantSlots(node, state.symbol_table.frame_slots());
+
+	const std::size_t local_count =
+	    state.symbol_table.frame_slots() + state.invariants.count();
+
+	/* 関数本体を先に生成して、使ったレジスタを調べる */
+	out.function(node.value);
+	const auto body_begin = out.instructions.size();
+	gen_statement(*node.child[0], state);
+	const std::size_t saved_count =
+	    std::min(state.depth_count, register_count);
+
+	// ローカル変数、ループ不変式と退避したレジスタの領域（16 の倍数に揃える）
+	const std::size_t frame_size =
+	    (local_count + saved_count + 1) / 2 * 16;
+	const auto save_slot = [&](std::size_t i) {
+		return memory(Register::rbp,
+		              -static_cast<std::int32_t>((local_count + i + 1) * 8));
+	};
+
+	// 末尾呼び出しの前でエピローグと同じくフレームを畳む（後ろから挿入する）
+	for (auto jump = state.tail_jumps.rbegin(); jump != state.tail_jumps.rend();
+	     ++jump) {
+		Assembly teardown;
+		for (std::size_t i = 0; i < saved_count; ++i) {
+			teardown.mov(registers[i], save_slot(i));
+		}
+		teardown.mov(Register::rsp, Register::rbp);
+		teardown.pop(Register::rbp);
+		out.instructions.insert(out.instructions.begin() + *jump,
+		                        teardown.instructions.begin(),
+		                        teardown.instructions.end());
+	}
+
+	// プロローグ（本体の前に挿入する）
+	Assembly prologue;
+	prologue.push(Register::rbp);
+	prologue.mov(Register::rbp, Register::rsp);
+	prologue.sub(Register::rsp, static_cast<std::int64_t>(frame_size));
+	for (std::size_t i = 0; i < saved_count; ++i) {
+		prologue.mov(save_slot(i), registers[i]);
+	}
+
+	/* 仮引数に実引数を代入 */
+	if (state.recursive) {
+		prologue.bind(state.recursion_label);
+	}
+	for (std::size_t i = 0; i < node.parameters().size(); ++i) {
+		prologue.mov(local_variable(node.parameters()[i], state),
+		             argument_registers[i]);
+	}
+	out.instructions.insert(out.instructions.begin() + body_begin,
+	                        prologue.instructions.begin(),
+	                        prologue.instructions.end());
+
+	// エピローグ
+	out.bind(state.return_label);
+	for (std::size_t i = 0; i < saved_count; ++i) {
+		out.mov(registers[i], save_slot(i));
+	}
+	out.mov(Register::rsp, Register::rbp);
+	out.pop(Register::rbp);
+	out.ret();
+}
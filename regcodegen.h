@@ -0,0 +1,12 @@
+#ifndef INCLUDE_GUARD_REGCODEGEN_
+#define INCLUDE_GUARD_REGCODEGEN_
+
+#include "assembly.h"
+#include "parser.h"
+
+// generate function definition with expression temporaries kept in registers
+// (values are spilled to stack only when registers run out)
+// functions share no state, so they can be generated concurrently
+void gen_register_function(const Node &function, Assembly &out);
+
+#endif
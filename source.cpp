@@ -0,0 +1,91 @@
+#include "source.h"
+#include "error.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+Source::~Source() {
+	if (mapping) {
+		munmap(mapping, mapping_size);
+	}
+}
+
+std::shared_ptr<const Source> Source::from_text(std::string_view text) {
+	std::shared_ptr<Source> source(new Source);
+	source->owned = text;
+	source->text_ = source->owned; // std::string is NUL terminated
+	return source;
+}
+
+std::shared_ptr<const Source> Source::from_file(const char *path) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		error("Cannot open "s + path + ": " + std::strerror(errno));
+	}
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+		// pipes and devices cannot be mapped
+		auto source = from_stream(fd);
+		close(fd);
+		return source;
+	}
+
+	/**
+	 * 読み取り専用の無名ページを 1 ページ多く確保して、その先頭にファイルを重ねる
+	 * ファイルの後ろは必ず 0 で埋まったページなので、NUL 終端になる
+	 */
+	const std::size_t size      = status.st_size;
+	const std::size_t page_size = sysconf(_SC_PAGESIZE);
+	const std::size_t file_pages =
+	    (size + page_size - 1) / page_size * page_size;
+
+	std::shared_ptr<Source> source(new Source);
+	source->mapping_size = file_pages + page_size;
+	source->mapping = mmap(nullptr, source->mapping_size, PROT_READ,
+	                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == source->mapping) {
+		source->mapping = nullptr;
+		close(fd);
+		error("Cannot map "s + path + ": " + std::strerror(errno));
+	}
+	if (size != 0 && MAP_FAILED == mmap(source->mapping, size, PROT_READ,
+	                                    MAP_PRIVATE | MAP_FIXED, fd, 0)) {
+		close(fd);
+		error("Cannot map "s + path + ": " + std::strerror(errno));
+	}
+	close(fd);
+
+	source->text_ =
+	    std::string_view(static_cast<const char *>(source->mapping), size);
+	return source;
+}
+
+std::shared_ptr<const Source> Source::from_stream(int fd) {
+	constexpr std::size_t chunk_size = 1 << 16;
+
+	std::shared_ptr<Source> source(new Source);
+	auto                   &text = source->owned;
+	for (;;) {
+		const auto used = text.size();
+		text.resize(used + chunk_size);
+		const auto count = ::read(fd, text.data() + used, chunk_size);
+		if (count < 0 && errno == EINTR) {
+			text.resize(used);
+			continue;
+		}
+		if (count < 0) {
+			error("Failed to read source: "s + std::strerror(errno));
+		}
+		text.resize(used + count);
+		if (count == 0) {
+			break;
+		}
+	}
+	source->text_ = text;
+	return source;
+}
@@ -0,0 +1,41 @@
+#ifndef INCLUDE_GUARD_SOURCE_
+#define INCLUDE_GUARD_SOURCE_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * source text which all tokens refer to
+ * a file is mapped into memory as it is (not copied)
+ * the text is always followed by a NUL, since error() scans a line up to
+ * LF or NUL
+ */
+class Source {
+private:
+	std::string_view text_;
+	std::string      owned;                // text not from a file
+	void            *mapping      = nullptr; // mmap-ed file
+	std::size_t      mapping_size = 0;
+
+	Source() = default;
+
+public:
+	Source(const Source &) = delete;
+	Source &operator=(const Source &) = delete;
+	~Source();
+
+	// copy of text (e.g. given as an argument)
+	static std::shared_ptr<const Source> from_text(std::string_view text);
+	// map the file into memory
+	static std::shared_ptr<const Source> from_file(const char *path);
+	// read until EOF in chunks (e.g. stdin, which cannot be mapped)
+	static std::shared_ptr<const Source> from_stream(int fd);
+
+	std::string_view text() const {
+		return text_;
+	}
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "strength.h"
+#include <bit>
+#include <cassert>
+
+// |value| (-2^63 も 2^63 として表せるように unsigned で返す)
+static std::uint64_t magnitude(std::int64_t value) {
+	const auto bits = static_cast<std::uint64_t>(value);
+	return value < 0 ? 0 - bits : bits;
+}
+
+const Node *constant_operand(const Node &node) {
+	const auto is_number = [&](std::size_t i) {
+		return Node::node_type::number == node.child[i]->type;
+	};
+	switch (node.type) {
+	case Node::node_type::multiplication:
+		if (is_number(1)) {
+			return node.child[1];
+		}
+		return is_number(0) ? node.child[0] : nullptr;
+	case Node::node_type::division:
+		return is_number(1) ? node.child[1] : nullptr;
+	default:
+		return nullptr;
+	}
+}
+
+bool gen_multiply_constant(Assembly &out, Register dst, Register scratch,
+                           std::int64_t value) {
+	assert(dst != scratch);
+
+	const auto absolute = magnitude(value);
+	if (absolute == 0) {
+		out.mov(dst, 0);
+		return true;
+	}
+
+	/* |value| = 2^k, 2^k + 1, 2^k - 1 の時だけ（それ以外は imul の方が速い） */
+	if (std::has_single_bit(absolute)) {
+		const auto k = std::countr_zero(absolute);
+		if (k != 0) {
+			out.shl(dst, k);
+		}
+	} else if (std::has_single_bit(absolute - 1)) {
+		out.mov(scratch, dst);
+		out.shl(dst, std::countr_zero(absolute - 1));
+		out.add(dst, scratch);
+	} else if (std::has_single_bit(absolute + 1)) {
+		out.mov(scratch, dst);
+		out.shl(dst, std::countr_zero(absolute + 1));
+		out.sub(dst, scratch);
+	} else {
+		return false;
+	}
+	if (value < 0) {
+		out.neg(dst); // 2^64 を法とするので -2^63 でも正しい
+	}
+	return true;
+}
+
+namespace {
+// n / d = (n * multiplier の上位 64 bit (± n)) >> shift (負なら + 1)
+struct Magic {
+	std::int64_t multiplier;
+	unsigned     shift;
+};
+} // namespace
+
+/**
+ * 符号付き除算の magic number
+ * (Hacker's Delight, 10-4 "Signed Division by Divisors >= 2", d は 0, ±1,
+ * ±2^k 以外)
+ */
+static Magic signed_magic(std::int64_t divisor) {
+	constexpr std::uint64_t two63 = std::uint64_t(1) << 63;
+
+	const auto ad  = magnitude(divisor);
+	const auto t   = two63 + (static_cast<std::uint64_t>(divisor) >> 63);
+	const auto anc = t - 1 - t % ad; // |nc|
+	unsigned   p   = 63;
+	auto       q1  = two63 / anc; // 2^p / |nc|
+	auto       r1  = two63 - q1 * anc;
+	auto       q2  = two63 / ad; // 2^p / |d|
+	auto       r2  = two63 - q2 * ad;
+
+	std::uint64_t delta;
+	do {
+		++p;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			++q1;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			++q2;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	const auto multiplier = q2 + 1;
+	return Magic{static_cast<std::int64_t>(divisor < 0 ? 0 - multiplier
+	                                                   : multiplier),
+	             p - 64};
+}
+
+bool gen_divide_constant(Assembly &out, std::int64_t divisor,
+                         Register scratch) {
+	assert(Register::rax != scratch && Register::rdx != scratch);
+
+	if (divisor == 0 || divisor == -1) {
+		return false;
+	}
+	if (divisor == 1) {
+		return true;
+	}
+
+	const auto absolute = magnitude(divisor);
+	if (std::has_single_bit(absolute)) {
+		// 負の数は 2^k - 1 を足してから算術シフトする（0 方向への丸め）
+		const auto k = std::countr_zero(absolute);
+		out.mov(Register::rdx, Register::rax);
+		if (k != 1) {
+			out.sar(Register::rdx, 63);
+		}
+		out.shr(Register::rdx, 64 - k);
+		out.add(Register::rax, Register::rdx);
+		out.sar(Register::rax, k);
+		if (divisor < 0) {
+			out.neg(Register::rax);
+		}
+		return true;
+	}
+
+	const auto magic = signed_magic(divisor);
+	const bool add   = divisor > 0 && magic.multiplier < 0;
+	const bool sub   = divisor < 0 && magic.multiplier > 0;
+	if (add || sub) {
+		out.mov(scratch, Register::rax);
+	}
+	out.mov(Register::rdx, magic.multiplier);
+	out.imul_high(Register::rdx);
+	if (add) {
+		out.add(Register::rdx, scratch);
+	} else if (sub) {
+		out.sub(Register::rdx, scratch);
+	}
+	if (magic.shift != 0) {
+		out.sar(Register::rdx, magic.shift);
+	}
+	// 商が負なら 1 を足す（0 方向への丸め）
+	out.mov(Register::rax, Register::rdx);
+	out.shr(Register::rax, 63);
+	out.add(Register::rax, Register::rdx);
+	return true;
+}
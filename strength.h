@@ -0,0 +1,32 @@
+#ifndef INCLUDE_GUARD_STRENGTH_
+#define INCLUDE_GUARD_STRENGTH_
+
+#include "assembly.h"
+
+/**
+ * strength reduction of multiplication and division by a constant
+ * (shared by the backends; the results are the same as imul / idiv)
+ */
+
+/**
+ * number operand of multiplication (either side) or divisor of division
+ * node that can be reduced, nullptr if none
+ */
+const Node *constant_operand(const Node &node);
+
+/**
+ * dst = dst * value with shifts and add/sub (scratch is overwritten)
+ * returns false without emitting anything if imul is the better choice
+ */
+bool gen_multiply_constant(Assembly &out, Register dst, Register scratch,
+                           std::int64_t value);
+
+/**
+ * rax = rax / divisor rounded toward zero, with shifts or a multiplication
+ * by the "magic number" (rdx and scratch are overwritten)
+ * returns false without emitting anything for 0 and -1, where idiv traps
+ */
+bool gen_divide_constant(Assembly &out, std::int64_t divisor,
+                         Register scratch);
+
+#endif
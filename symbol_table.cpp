@@ -0,0 +1,137 @@
+#include "symbol_table.h"
+#include "error.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+// 解析中のブロック（compound statement）
+struct Block {
+	const Node *node;
+	std::size_t parent; // 親ブロックの番号（関数本体は自分自身）
+	std::size_t depth;  // 関数本体からの深さ
+};
+struct Analysis {
+	std::vector<Block>                      blocks; // 先行順
+	std::unordered_map<Symbol, std::size_t> home;   // 変数を置くブロック
+	std::vector<Symbol>                     order;  // 変数の初出順
+	std::span<const Symbol>                 parameters;
+};
+} // namespace
+
+// ブロック a と b の両方を含む最も内側のブロック
+static std::size_t common_block(const std::vector<Block> &blocks, std::size_t a,
+                                std::size_t b) {
+	while (blocks[a].depth > blocks[b].depth) {
+		a = blocks[a].parent;
+	}
+	while (blocks[b].depth > blocks[a].depth) {
+		b = blocks[b].parent;
+	}
+	while (a != b) {
+		a = blocks[a].parent;
+		b = blocks[b].parent;
+	}
+	return a;
+}
+
+// identifier がブロック block で使われた
+static void use(Analysis &analysis, Symbol identifier, std::size_t block) {
+	if (std::find(analysis.parameters.begin(), analysis.parameters.end(),
+	              identifier) != analysis.parameters.end()) {
+		return; // 仮引数は関数のスコープにある
+	}
+
+	if (auto found = analysis.home.find(identifier);
+	    found != analysis.home.end()) {
+		found->second = common_block(analysis.blocks, found->second, block);
+	} else {
+		analysis.home.emplace(identifier, block);
+		analysis.order.push_back(identifier);
+	}
+}
+
+static void analyse(Analysis &analysis, const Node &node, std::size_t block) {
+	if (Node::node_type::statements == node.type) {
+		const auto parent = analysis.blocks.empty() ? 0 : block;
+		const auto depth =
+		    analysis.blocks.empty() ? 0 : analysis.blocks[block].depth + 1;
+		analysis.blocks.push_back(Block{&node, parent, depth});
+		block = analysis.blocks.size() - 1;
+	}
+
+	if (Node::node_type::identifier == node.type) {
+		use(analysis, node.value, block);
+	}
+	if (Node::node_type::address == node.type) {
+		// アドレスが取られた変数はどこから参照されるか分からない
+		assert(Node::node_type::identifier == node.child[0]->type);
+		use(analysis, node.child[0]->value, 0);
+	}
+
+	for (const auto &child : node.child) {
+		analyse(analysis, *child, block);
+	}
+}
+
+SymbolTable::SymbolTable(const Node &function) {
+	assert(Node::node_type::function == function.type);
+	assert(function.child.size() == 1);
+	assert(Node::node_type::statements == function.child[0]->type);
+
+	Analysis analysis;
+	analysis.parameters = function.parameters();
+	analyse(analysis, *function.child[0], 0);
+
+	for (const auto identifier : analysis.order) {
+		const auto &block = analysis.blocks[analysis.home.at(identifier)];
+		block_variables[block.node].push_back(identifier);
+	}
+
+	// 仮引数は関数のスコープ
+	scopes.emplace_back();
+	for (const auto parameter : function.parameters()) {
+		declare(parameter);
+	}
+	slot_count = used_slots + analysis.order.size();
+}
+
+void SymbolTable::declare(Symbol identifier) {
+	assert(!scopes.empty());
+
+	if (scopes.back().contains(identifier)) {
+		return;
+	}
+	++used_slots;
+	scopes.back().emplace(identifier, used_slots * 8);
+}
+
+void SymbolTable::enter_block(const Node &block) {
+	assert(Node::node_type::statements == block.type);
+
+	scopes.emplace_back();
+	if (auto found = block_variables.find(&block);
+	    found != block_variables.end()) {
+		for (const auto identifier : found->second) {
+			declare(identifier);
+		}
+	}
+	assert(used_slots <= slot_count);
+}
+
+void SymbolTable::leave_block() {
+	assert(scopes.size() > 1);
+
+	// 宣言の無い変数は関数全体で生きている（ループの次の周回でも値を読む）
+	// ので、このブロックのスロットは兄弟ブロックでも再利用しない
+	scopes.pop_back();
+}
+
+std::size_t SymbolTable::offset(Symbol identifier) const {
+	for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+		if (auto found = scope->find(identifier); found != scope->end()) {
+			return found->second;
+		}
+	}
+
+	error("識別子が見つかりませんでした");
+}
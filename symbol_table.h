@@ -0,0 +1,48 @@
+#ifndef INCLUDE_GUARD_SYMBOL_TABLE_
+#define INCLUDE_GUARD_SYMBOL_TABLE_
+
+#include "ast.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * local variables of a function and their stack slots
+ *
+ * The language has no declarations, so every variable is placed in the
+ * innermost block (compound statement) that contains all of its uses.
+ * Dummy arguments and variables whose address is taken stay in the
+ * function scope. Every variable still has a slot of its own: it keeps
+ * its value for the whole function (e.g. across iterations of a loop around
+ * its block), so sibling blocks cannot share slots.
+ */
+class SymbolTable {
+private:
+	// rbp からのオフセット（innermost scope が最後）
+	std::vector<std::unordered_map<Symbol, std::size_t>> scopes;
+	// ブロックで宣言する変数（初出順）
+	std::unordered_map<const Node *, std::vector<Symbol>> block_variables;
+	std::size_t used_slots = 0; // 割り当てたスロット数
+	std::size_t slot_count = 0; // 必要なスロット数（全ての変数の数）
+
+	void declare(Symbol identifier);
+
+public:
+	// analyse function and open its scope with the dummy arguments
+	explicit SymbolTable(const Node &function);
+
+	// open the scope of block and declare its variables
+	void enter_block(const Node &block);
+	// close the innermost scope
+	void leave_block();
+
+	// address of identifier is rbp - offset(identifier)
+	std::size_t offset(Symbol identifier) const;
+
+	// number of 8 byte slots the frame needs for all variables
+	std::size_t frame_slots() const {
+		return slot_count;
+	}
+};
+
+#endif
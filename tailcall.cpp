@@ -0,0 +1,59 @@
+#include "tailcall.h"
+#include "variables.h"
+#include <cassert>
+
+using TailCalls = std::unordered_set<const Node *>;
+
+// return f(...)
+static void find_returned_calls(const Node &node, TailCalls &calls) {
+	if (Node::node_type::return_ == node.type &&
+	    Node::node_type::call == node.child[0]->type) {
+		calls.insert(node.child[0]);
+	}
+	for (const auto &child : node.child) {
+		find_returned_calls(*child, calls);
+	}
+}
+
+// statement の後は関数の末尾（その値が戻り値になる）
+static void find_trailing_calls(const Node &statement, TailCalls &calls) {
+	switch (statement.type) {
+	case Node::node_type::call:
+		calls.insert(&statement);
+		return;
+	case Node::node_type::statements:
+		if (!statement.child.empty()) {
+			find_trailing_calls(*statement.child[statement.child.size() - 1],
+			                    calls);
+		}
+		return;
+	case Node::node_type::if_:
+		find_trailing_calls(*statement.child[1], calls);
+		return;
+	case Node::node_type::ifelse_:
+		find_trailing_calls(*statement.child[1], calls);
+		find_trailing_calls(*statement.child[2], calls);
+		return;
+	default:
+		return;
+	}
+}
+
+std::unordered_set<const Node *> find_tail_calls(const Node &function) {
+	assert(Node::node_type::function == function.type);
+	assert(function.child.size() == 1);
+
+	TailCalls calls;
+	// & で取ったローカル変数のアドレスは、フレームを畳んだ後も使われうる
+	if (!find_escaped(*function.child[0]).empty()) {
+		return calls;
+	}
+	find_returned_calls(*function.child[0], calls);
+	find_trailing_calls(*function.child[0], calls);
+	return calls;
+}
+
+bool is_self_tail_call(const Node &function, const Node &call) {
+	return Node::node_type::call == call.type && call.value == function.value &&
+	       call.child.size() == function.parameters().size();
+}
@@ -0,0 +1,20 @@
+#ifndef INCLUDE_GUARD_TAILCALL_
+#define INCLUDE_GUARD_TAILCALL_
+
+#include "ast.h"
+#include <unordered_set>
+
+/**
+ * call nodes in tail position of function: their value is returned as is
+ * (return f(...), or the last expression statement of the body, including
+ * the last statements of the branches of a trailing if / if-else)
+ * the caller's frame can be torn down before jumping to such a callee
+ * (none if function takes the address of a variable, which may escape)
+ */
+std::unordered_set<const Node *> find_tail_calls(const Node &function);
+
+// tail call of function to itself with all of its dummy arguments
+// (can be a jump back to the top of the body)
+bool is_self_tail_call(const Node &function, const Node &call);
+
+#endif
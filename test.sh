@@ -1,19 +1,52 @@
 #!/bin/bash
+# each program is compiled with every configuration and all results must agree
+configurations=(
+	"--backend=stack --no-fold --no-peephole --no-inline --unroll=1"
+	"--backend=register --no-peephole"
+	"--backend=stack"
+	"--backend=register"
+	"--backend=stack -c"
+	"--backend=register -c"
+	"--backend=stack --run"
+	"--backend=register --run"
+	"--vm"
+	"--backend=ssa --passes="
+	"--backend=ssa"
+	"--backend=ssa --run"
+	# the second one reuses the code cached by the first one
+	"--backend=register --cache=tmp_cache"
+	"--backend=register --cache=tmp_cache -c"
+)
+rm -rf tmp_cache
+
 assert() {
 	expected="$1"
 	input="$2"
 
-	./9cc "$input" >tmp.s
-	cc -o tmp tmp.s
-	./tmp
-	actual="$?"
+	for options in "${configurations[@]}"; do
+		if [[ " $options " == *" --run "* || " $options " == *" --vm "* ]]; then
+			# --run, --vm: 9cc itself executes the program and exits with its status
+			./9cc $options "$input"
+			actual="$?"
+		else
+			# -c: 9cc writes an object file by itself
+			output=tmp.s
+			if [[ " $options " == *" -c "* ]]; then
+				output=tmp.o
+			fi
+			./9cc $options -o $output "$input" || exit 1
+			cc -o tmp $output
+			./tmp
+			actual="$?"
+		fi
 
-	if [ "$actual" = "$expected" ]; then
-		echo "$input => $actual"
-	else
-		echo "$input => $expected expected, but got $actual"
-		exit 1
-	fi
+		if [ "$actual" = "$expected" ]; then
+			echo "[$options] $input => $actual"
+		else
+			echo "[$options] $input => $expected expected, but got $actual"
+			exit 1
+		fi
+	done
 }
 
 assert 0 "
@@ -138,4 +171,279 @@ main () {
 }
 '
 
+# register pressure (temporaries spilled to stack)
+assert 36 'main(){
+	return 1+(2+(3+(4+(5+(6+(7+8))))));
+}'
+assert 21 'main(){
+	return sum(1, 2, 3, 4, 5, sum(0, 0, 0, 0, 1, 5));
+}
+sum (a, b, c, d, e, f) {
+	return a + b + c + d + e + f;
+}'
+
+# arguments are passed in the 6 argument registers only
+for options in "${configurations[@]}"; do
+	for input in 'f(a, b, c, d, e, g, h){ return h; } main(){ return 0; }' \
+	    'f(a){ return a; } main(){ return f(1, 2, 3, 4, 5, 6, 7); }'; do
+		if ! ./9cc $options "$input" 2>&1 >/dev/null |
+			grep -q "too many"; then
+			echo "[$options] $input => too many arguments expected"
+			exit 1
+		fi
+	done
+done
+
+# constant folding
+assert 3 'main(){
+	for (;;) return 3;
+}'
+assert 7 'main(){
+	a = 7;
+	while (0) a = 1;
+	if (2 - 2) a = 2;
+	if (1 < 0) return 1; else return a;
+}'
+assert 5 'main(){
+	b = (a = 5) * 0;
+	return a + b * 1 + 0 - - b;
+}'
+assert 253 'main(){
+	return -7 / 2 + 0 * 9;
+}'
+assert 42 'main(){
+	i = 0;
+	while (i < 1000000) i = i + 1;
+	return i - 999958;
+}'
+
+# block scopes (a variable used only in a block keeps its value across
+# iterations of a loop around it, so sibling blocks do not share slots)
+assert 12 'main(){
+	s = 0;
+	for (i = 0; i < 3; i = i + 1) { a = i; b = a + 1; s = s + b; }
+	if (s == 6) { c = 2; d = c * 3; s = s + d; }
+	return s;
+}'
+assert 7 'main(){
+	{ x = 7; p = &x; }
+	{ y = 1; z = 2; }
+	return *p;
+}'
+assert 42 'main(){
+	s = 0;
+	for (i = 0; i < 3; i = i + 1) {
+		{ if (i == 0) a = 40; else a = a + 1; s = a; }
+		{ b = 100; }
+	}
+	return s;
+}'
+
+# values merged at the loop head (phi) and repeated expressions (CSE)
+assert 21 'main(){
+	a = 1; b = 2;
+	for (i = 0; i < 5; i = i + 1) { t = a; a = b; b = t; }
+	return a * 10 + b;
+}'
+assert 39 'main(){
+	x = 3; y = 0;
+	if (x) y = x * x + 1; else y = x * x;
+	return y + x * x + (x * x + 1) * 2 + 0 * z;
+}'
+
+# comparisons as conditions jump without making 0 / 1
+assert 63 'main(){
+	a = -2; b = 3; r = 0;
+	if (a < b) r = r + 1;
+	if (b > a) r = r + 2;
+	if (a <= -2) r = r + 4;
+	if (b >= 4) r = r + 64; else r = r + 8;
+	if (a == -2) r = r + 16;
+	for (i = 0; i != 2; i = i + 1) if (i) r = r + 32;
+	while (a != a) r = 0;
+	return r;
+}'
+
+# multiplication and division by constants (shifts and magic numbers)
+# must agree with imul / idiv (through d and m) for every sign and edge value
+assert 0 'd(a, b){ return a / b; }
+m(a, b){ return a * b; }
+check(x){
+	e = (x / 2 != d(x, 2)) + (x / -2 != d(x, -2)) + (x / 8 != d(x, 8));
+	e = e + (x / 3 != d(x, 3)) + (x / -3 != d(x, -3)) + (x / 7 != d(x, 7));
+	e = e + (x / 10 != d(x, 10)) + (x / -641 != d(x, -641)) + (x / 1 != x);
+	e = e + (x / 1000000007 != d(x, 1000000007));
+	e = e + (x / 4611686018427387904 != d(x, 4611686018427387904));
+	e = e + (x * 0 != 0) + (x * -1 != m(x, -1)) + (x * 8 != m(x, 8));
+	e = e + (3 * x != m(x, 3)) + (x * -7 != m(x, -7)) + (x * 9 != m(x, 9));
+	e = e + (x * 10 != m(x, 10)) + (x * 4611686018427387904 != m(x, 4611686018427387904));
+	return e;
+}
+main(){
+	max = 9223372036854775807;
+	return check(0) + check(1) + check(-1) + check(7) + check(-7) +
+	       check(100) + check(-100) + check(max) + check(-max) + check(-max - 1);
+}'
+assert 246 'main(){
+	x = -7;
+	return x / 2 * 3 + x / -4 * 5 + x * 9 / 10;
+}'
+# calls in tail position reuse the frame (1000000 frames would overflow)
+assert 103 'sum(n, a){ if (n == 0) return a; return sum(n - 1, a + n); }
+count(n, a){ if (n == 0) a; else count(n - 1, a + 1); }
+even(n){ if (n == 0) return 1; return odd(n - 1); }
+odd(n){ if (n == 0) return 0; return even(n - 1); }
+main(){
+	return (sum(1000000, 0) == 500000500000) + (count(1000000, 0) == 1000000) * 2 +
+	       even(1000001) * 10 + odd(999999) * 100;
+}'
+assert 42 'get(p){ return *p; } f(n){ x = n * 2; return get(&x); } main(){ return f(21); }'
+
+# loop-invariant expressions are computed once before the loop
+assert 250 'main(){
+	n = 10; k = 3; s = 0;
+	for (i = 0; i < n * 2; i = i + 1) {
+		j = 0;
+		while (j < k + 1) {
+			s = s + k * n + i / 2 + j;
+			j = j + 1;
+		}
+	}
+	x = 0; p = &x;
+	for (i = 0; i < 5; i = i + 1) x = x + *p + k * 2;
+	return s + x;
+}'
+assert 68 'main(){
+	d = 0; s = 0;
+	while (s > 0) s = s + 10 / d + 7 / (d - 1);
+	for (k = 4; s < 50; s = s + k * k) d = d + 1;
+	return s + d * (k - 2) / 2;
+}'
+
+# counted for loops are unrolled: fully with a few constant iterations, and
+# otherwise by the factor with a loop for the remaining iterations
+assert 89 'sum(n){ s = 0; for (i = 0; i < n; i = i + 1) s = s + i * i; return s + i; }
+main(){
+	t = 0;
+	for (i = 1; i < 100; i = i + 2)
+		for (j = 0; j < 3; j = j + 1) t = t + j;
+	return sum(7) - sum(6) + sum(2) + sum(0) + t - i;
+}'
+assert 30 'main(){ s = 0; for (i = 0; i < 10; i = i + 3) s = s + i; return s + i; }'
+# (the unrolled loop is skipped when n - (factor - 1) * c would wrap)
+assert 1 'main(){
+	n = 0 - 9223372036854775807; c = 0;
+	for (i = 0 - 9223372036854775807 - 1; i < n; i = i + 1) c = c + 1;
+	return c;
+}'
+if ./9cc --unroll=0 "main(){ return 0; }" >/dev/null 2>&1; then
+	echo "[--unroll=0] not rejected"
+	exit 1
+fi
+
+# small leaf functions are inlined: as an expression, as a statement, and
+# hoisted out of an expression (arguments are still evaluated once, in order)
+assert 76 'sq(x){ return x * x; }
+clamp(v, lo, hi){ r = v; if (r < lo) r = lo; if (hi < r) r = hi; return r; }
+tri(n){ s = 0; for (i = 1; i <= n; i = i + 1) s = s + i; s; }
+swap(b, a){ return a - b; }
+peek(p){ return *p + 1; }
+main(){
+	x = 3;
+	y = clamp(sq(x) + 5, 0, 12);
+	y = y + tri(4) * 2 + swap(1, 10) + sq(x + 1);
+	z = 1;
+	if (x) y = y + clamp(peek(&z), 0, 1);
+	return y + sq(labs(x - 7)) + peek(&z);
+}'
+assert 23 'twice(x){ return x + x; } main(){ n = 0; a = twice(n = n + 5) + twice(n = n + 3); return a - n + 5; }'
+if ./9cc 'add(a, b){ return a + b; } main(){ return add(1, 2) * 3; }' | grep -q "call add" ||
+	! ./9cc --no-inline 'add(a, b){ return a + b; } main(){ return add(1, 2) * 3; }' | grep -q "call add" ||
+	./9cc --inline-budget=x "main(){ return 0; }" >/dev/null 2>&1; then
+	echo "[--no-inline --inline-budget] not honoured"
+	exit 1
+fi
+
+# inlined variables are numbered in each function, so changing f leaves the
+# cached code of g in use (4 functions, then only f again)
+rm -rf tmp_cache
+./9cc --cache=tmp_cache -o tmp.s 'sq(x){ return x * x; } f(a){ b = sq(a + 1); return b; }
+g(a){ c = sq(a + 2); return c; } main(){ return f(1) + g(2); }' &&
+	./9cc --cache=tmp_cache -o tmp.s 'sq(x){ return x * x; } f(a){ b = sq(a + 1) + sq(a + 3); return b; }
+g(a){ c = sq(a + 2); return c; } main(){ return f(1) + g(2); }' || exit 1
+if [ "$(ls tmp_cache | wc -l)" != 5 ]; then
+	echo "[--cache] inlined variables of g depend on f"
+	exit 1
+fi
+
+# calls into the C library (relocated by the linker with -c)
+assert 7 'main(){
+	return labs(0 - 7);
+}'
+assert 42 'main(){
+	x = 5000000000;
+	return x / 1000000000 * 8 + 2;
+}'
+
+# functions generated on several threads are output in source order
+program='main(){ return f(1) + g(2); }
+f(x){ if (x) return x; return 0; }
+g(x){ while (x < 5) x = x + 1; return x; }'
+for backend in stack register ssa; do
+	./9cc --backend=$backend --jobs=1 -o tmp1.s "$program" || exit 1
+	./9cc --backend=$backend --jobs=4 -o tmp4.s "$program" || exit 1
+	if ! cmp -s tmp1.s tmp4.s; then
+		echo "[--backend=$backend] output differs between --jobs=1 and --jobs=4"
+		exit 1
+	fi
+done
+
+if ./9cc --backend=ssa --passes=cse,nothing "main(){ return 0; }" >/dev/null 2>&1; then
+	echo "[--passes] an unknown pass was accepted"
+	exit 1
+fi
+
+# batch: each input file has its own output, and a bad file stops no others
+echo 'main(){ return f(2); } f(x){ return x * 21; }' > tmp_batch1.c
+echo 'main(){ return 7; }' > tmp_batch2.c
+echo 'main(){ return 1 +; }' > tmp_batch3.c
+if ./9cc --batch --jobs=2 tmp_batch1.c tmp_batch2.c tmp_batch3.c 2>/dev/null; then
+	echo "[--batch] a bad input file was not reported"
+	exit 1
+fi
+for expected in "tmp_batch1 42" "tmp_batch2 7"; do
+	set -- $expected
+	cc -o tmp $1.s
+	./tmp
+	actual="$?"
+	if [ "$actual" != "$2" ]; then
+		echo "[--batch] $1.c => $2 expected, but got $actual"
+		exit 1
+	fi
+	echo "[--batch] $1.c => $actual"
+done
+
+# source read from a file (mapped into memory) and from stdin
+echo 'main(){ return 6 * 7; }' > tmp_source.c
+for input in "-f tmp_source.c" "-f - <tmp_source.c"; do
+	eval ./9cc --run $input
+	actual="$?"
+	if [ "$actual" != 42 ]; then
+		echo "[$input] => 42 expected, but got $actual"
+		exit 1
+	fi
+	echo "[$input] => $actual"
+done
+
+# phase statistics and Chrome trace of the compilation
+if ! ./9cc --stats --trace=tmp_trace.json -o tmp.s "main(){ return f(1); } f(x){ return x; }" 2>tmp_stats.txt; then
+	echo "[--stats --trace] compilation failed"
+	exit 1
+fi
+if ! grep -q "^codegen (functions) *2 " tmp_stats.txt || ! grep -q '"traceEvents"' tmp_trace.json; then
+	echo "[--stats --trace] phases were not reported"
+	exit 1
+fi
+echo "[--stats --trace] OK"
+
 echo OK
@@ -0,0 +1,101 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+// tasks of a worker (the owner takes from the back, thieves from the front)
+struct WorkQueue {
+	std::mutex              mutex;
+	std::deque<std::size_t> tasks;
+
+	std::optional<std::size_t> pop_back() {
+		std::lock_guard lock(mutex);
+		if (tasks.empty()) {
+			return std::nullopt;
+		}
+		const auto task = tasks.back();
+		tasks.pop_back();
+		return task;
+	}
+	std::optional<std::size_t> pop_front() {
+		std::lock_guard lock(mutex);
+		if (tasks.empty()) {
+			return std::nullopt;
+		}
+		const auto task = tasks.front();
+		tasks.pop_front();
+		return task;
+	}
+};
+} // namespace
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+    : thread_count(thread_count) {
+	if (this->thread_count == 0) {
+		this->thread_count =
+		    std::max(1u, std::thread::hardware_concurrency());
+	}
+}
+
+void ThreadPool::parallel_for(std::size_t                              count,
+                              const std::function<void(std::size_t)> &task) {
+	const auto worker_count = std::min(thread_count, count);
+	if (worker_count <= 1) {
+		for (std::size_t i = 0; i < count; ++i) {
+			task(i);
+		}
+		return;
+	}
+
+	// 連続した範囲ずつ配っておき、
+	// 自分の分が無くなったら他のワーカーの残りの先頭から盗む
+	std::vector<WorkQueue> queues(worker_count);
+	for (std::size_t i = 0; i < count; ++i) {
+		queues[i * worker_count / count].tasks.push_back(i);
+	}
+	// 前から順に処理するため、自分の分は後ろから取る
+	for (auto &queue : queues) {
+		std::reverse(queue.tasks.begin(), queue.tasks.end());
+	}
+
+	std::mutex         exception_mutex;
+	std::exception_ptr exception;
+
+	const auto work = [&](std::size_t self) {
+		for (;;) {
+			auto next = queues[self].pop_back();
+			for (std::size_t i = 1; !next && i < worker_count; ++i) {
+				next = queues[(self + i) % worker_count].pop_front();
+			}
+			// 実行中に仕事が増えることはないので、全部空なら終わり
+			if (!next) {
+				return;
+			}
+			try {
+				task(*next);
+			} catch (...) {
+				std::lock_guard lock(exception_mutex);
+				if (!exception) {
+					exception = std::current_exception();
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (std::size_t i = 1; i < worker_count; ++i) {
+		workers.emplace_back(work, i);
+	}
+	work(0);
+	for (auto &worker : workers) {
+		worker.join();
+	}
+	if (exception) {
+		std::rethrow_exception(exception);
+	}
+}
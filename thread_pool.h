@@ -0,0 +1,30 @@
+#ifndef INCLUDE_GUARD_THREAD_POOL_
+#define INCLUDE_GUARD_THREAD_POOL_
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * runs independent tasks on worker threads
+ * each worker has its own queue, and steals from the others when it runs out
+ * the calling thread works as one of the workers
+ */
+class ThreadPool {
+private:
+	std::size_t thread_count;
+
+public:
+	// thread_count == 0 means the number of hardware threads
+	explicit ThreadPool(std::size_t thread_count);
+
+	std::size_t size() const {
+		return thread_count;
+	}
+
+	// call task(i) for each 0 <= i < count, and wait for all of them
+	// if tasks throw, the first exception is rethrown after all of them end
+	void parallel_for(std::size_t                              count,
+	                  const std::function<void(std::size_t)> &task);
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "tokenizer.h"
 #include "error.h"
-#include <vector>
+#include <algorithm>
+#include <iterator>
 
 using namespace std::string_literals;
 
@@ -8,8 +9,11 @@ void Tokenizer::remove_prefix(std::string_view &str, std::size_t count) {
 	str.remove_prefix(count);
 	remove_length += count;
 }
-Tokenizer::Tokenizer(std::string_view token_str)
-    : token_str(token_str) {
+Tokenizer::Tokenizer(std::shared_ptr<const Source> source)
+    : source(std::move(source)) {
+	// tokens are views of the source text
+	auto token_str = this->source->text();
+
 	std::size_t line_num = 0; // token line index
 	while (token_str.length()) {
 		/* consume to a LF */
@@ -29,7 +33,7 @@ Tokenizer::Tokenizer(std::string_view token_str)
 		remove_length = 0;
 
 		/* consume a line token */
-		std::string this_line(token_line);
+		const auto this_line = token_line;
 		while (token_line.length()) {
 			/* remove blanks */
 			if (std::isblank(token_line.front())) {
@@ -47,16 +51,17 @@ Tokenizer::Tokenizer(std::string_view token_str)
 
 			/* symbol */
 			{
-				const std::vector<const char *> operators = {
+				static constexpr std::string_view operators[] = {
 				    "==", "!=", ">=", "<=", ">", "<", "+", "-", "*",
 				    "/",  "(",  ")",  "=",  ";", "{", "}", ",", "&"};
-				if (auto found_op = std::find_if(operators.begin(), operators.end(),
+				if (auto found_op = std::find_if(std::begin(operators),
+				                                 std::end(operators),
 				                                 [&token_line](const auto &op) {
 					                                 return token_line.starts_with(op);
 				                                 });
-				    found_op != operators.end()) {
-					std::string op(*found_op);
-					token_list.push_back(Token{op, this_line, line_num, remove_length});
+				    found_op != std::end(operators)) {
+					const auto op = token_line.substr(0, found_op->length());
+					token_list.push_back(Token{op, line_num, remove_length});
 					remove_prefix(token_line, op.length());
 					continue;
 				}
@@ -70,8 +75,7 @@ Tokenizer::Tokenizer(std::string_view token_str)
 				}
 
 				auto num_str = token_line.substr(0, first_notdigit_index);
-				token_list.push_back(
-				    Token{std::string(num_str), this_line, line_num, remove_length});
+				token_list.push_back(Token{num_str, line_num, remove_length});
 				remove_prefix(token_line, first_notdigit_index);
 				continue;
 			}
@@ -85,8 +89,7 @@ Tokenizer::Tokenizer(std::string_view token_str)
 				}
 
 				auto num_str = token_line.substr(0, first_not_identifier_index);
-				token_list.push_back(
-				    Token{std::string(num_str), this_line, line_num, remove_length});
+				token_list.push_back(Token{num_str, line_num, remove_length});
 				remove_prefix(token_line, first_not_identifier_index);
 				continue;
 			}
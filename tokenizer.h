@@ -1,15 +1,17 @@
 #ifndef INCLUDE_GUARD_TOKENIZER_
 #define INCLUDE_GUARD_TOKENIZER_
 
+#include "source.h"
 #include <cstddef>
-#include <list>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 struct Token {
-	std::string value;    // token string
-	std::string line;     // line with this token
-	std::size_t line_num; // token line index
-	std::size_t pos;      // token position of line (byte index)
+	std::string_view value;    // token string (view of the source text)
+	std::size_t      line_num; // token line index
+	std::size_t      pos;      // token position of line (byte index)
 };
 class Tokenizer {
 	friend class Parser;
@@ -17,13 +19,23 @@ class Tokenizer {
 	                                const Tokenizer &tokenizer);
 
 private:
-	std::list<Token>  token_list;
-	const std::string token_str;
-	std::size_t       remove_length = 0;
-	void              remove_prefix(std::string_view &str, std::size_t count);
+	std::vector<Token> token_list;
+	// source text which all tokens refer to (shared with Parser)
+	std::shared_ptr<const Source> source;
+	std::size_t                   remove_length = 0;
+	void remove_prefix(std::string_view &str, std::size_t count);
 
 public:
-	Tokenizer(std::string_view token_str);
+	// tokens refer to source directly (it is not copied)
+	Tokenizer(std::shared_ptr<const Source> source);
+	// tokens refer to a copy of token_str
+	Tokenizer(std::string_view token_str)
+	    : Tokenizer(Source::from_text(token_str)) {}
+
+	// number of tokens
+	std::size_t size() const {
+		return token_list.size();
+	}
 };
 
 #endif
@@ -0,0 +1,232 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <sys/resource.h>
+#include <vector>
+
+namespace {
+struct SpanRecord {
+	std::string   name;
+	std::string   category;
+	std::uint32_t thread;
+	double        start_us;
+	double        duration_us;
+	std::uint64_t allocation_count;
+	std::uint64_t allocation_bytes;
+	long          peak_rss_kib;
+	std::uint64_t work;
+	std::string   unit;
+};
+
+// row of the summary (all records of the same phase)
+struct SummaryRow {
+	std::string   name;
+	std::size_t   calls            = 0;
+	double        duration_us      = 0;
+	std::uint64_t allocation_count = 0, allocation_bytes = 0;
+	long          peak_rss_kib     = 0;
+	std::uint64_t work             = 0;
+	std::string   unit;
+
+	// work per second (0 if no work is recorded)
+	double rate() const {
+		return duration_us > 0 ? work / (duration_us / 1e6) : 0;
+	}
+};
+
+std::atomic<bool> enabled = false;
+
+// allocations are counted per thread, so parallel spans do not mix
+thread_local std::uint64_t thread_allocation_count = 0;
+thread_local std::uint64_t thread_allocation_bytes = 0;
+
+std::mutex                            records_mutex;
+std::vector<SpanRecord>               records;
+std::chrono::steady_clock::time_point origin;
+
+// 0 for the first thread that records a span, 1 for the next, ...
+std::uint32_t thread_number() {
+	static std::atomic<std::uint32_t> next = 0;
+	thread_local const std::uint32_t  number = next++;
+	return number;
+}
+
+long peak_rss_kib() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss; // Linux では KiB
+}
+} // namespace
+
+/* 全ての確保を数える（有効な間だけ） */
+void *operator new(std::size_t size) {
+	if (enabled.load(std::memory_order_relaxed)) {
+		++thread_allocation_count;
+		thread_allocation_bytes += size;
+	}
+	if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+void operator delete(void *pointer) noexcept {
+	std::free(pointer);
+}
+void operator delete(void *pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+void enable_tracing() {
+	origin = std::chrono::steady_clock::now();
+	enabled.store(true);
+}
+bool tracing_enabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+TraceSpan::TraceSpan(std::string_view name, std::string_view category)
+    : active(tracing_enabled()) {
+	if (!active) {
+		return;
+	}
+	this->name       = name;
+	this->category   = category;
+	allocation_count = thread_allocation_count;
+	allocation_bytes = thread_allocation_bytes;
+	start            = std::chrono::steady_clock::now();
+}
+
+TraceSpan::~TraceSpan() {
+	if (!active) {
+		return;
+	}
+	const auto end = std::chrono::steady_clock::now();
+	using microseconds = std::chrono::duration<double, std::micro>;
+
+	SpanRecord record{std::move(name),
+	                  std::move(category),
+	                  thread_number(),
+	                  microseconds(start - origin).count(),
+	                  microseconds(end - start).count(),
+	                  thread_allocation_count - allocation_count,
+	                  thread_allocation_bytes - allocation_bytes,
+	                  peak_rss_kib(),
+	                  work,
+	                  std::move(unit)};
+	std::lock_guard lock(records_mutex);
+	records.push_back(std::move(record));
+}
+
+void TraceSpan::count(std::uint64_t amount, std::string_view unit) {
+	work += amount;
+	this->unit = unit;
+}
+
+// records summed up per phase (in order of first appearance)
+static std::vector<SummaryRow> summarize() {
+	std::lock_guard         lock(records_mutex);
+	std::vector<SummaryRow> rows;
+	for (const auto &record : records) {
+		const auto name =
+		    record.category == "function" ? "codegen (functions)" : record.name;
+		auto row = std::find_if(
+		    rows.begin(), rows.end(),
+		    [&](const SummaryRow &row) { return row.name == name; });
+		if (row == rows.end()) {
+			row       = rows.insert(rows.end(), SummaryRow());
+			row->name = name;
+		}
+		++row->calls;
+		row->duration_us += record.duration_us;
+		row->allocation_count += record.allocation_count;
+		row->allocation_bytes += record.allocation_bytes;
+		row->peak_rss_kib = std::max(row->peak_rss_kib, record.peak_rss_kib);
+		row->work += record.work;
+		if (!record.unit.empty()) {
+			row->unit = record.unit;
+		}
+	}
+	return rows;
+}
+
+void write_trace_summary(std::ostream &stream) {
+	const auto rows = summarize();
+
+	stream << std::left << std::setw(24) << "phase" << std::right
+	       << std::setw(8) << "calls" << std::setw(12) << "time(ms)"
+	       << std::setw(12) << "allocs" << std::setw(14) << "alloc bytes"
+	       << std::setw(16) << "peak RSS(KiB)" << "  throughput\n";
+	for (const auto &row : rows) {
+		stream << std::left << std::setw(24) << row.name << std::right
+		       << std::setw(8) << row.calls << std::setw(12) << std::fixed
+		       << std::setprecision(3) << row.duration_us / 1000
+		       << std::setw(12) << row.allocation_count << std::setw(14)
+		       << row.allocation_bytes << std::setw(16) << row.peak_rss_kib;
+		if (!row.unit.empty()) {
+			stream << "  " << std::setprecision(0) << row.rate() << " "
+			       << row.unit << "/s (" << row.work << ")";
+		}
+		stream << "\n";
+	}
+}
+
+void write_trace_tsv(std::ostream &stream) {
+	stream << "phase\tcalls\ttime_ms\tallocs\talloc_bytes\tpeak_rss_kib\t"
+	          "work\tunit\tper_second\n";
+	for (const auto &row : summarize()) {
+		stream << row.name << '\t' << row.calls << '\t' << std::fixed
+		       << std::setprecision(3) << row.duration_us / 1000 << '\t'
+		       << row.allocation_count << '\t' << row.allocation_bytes << '\t'
+		       << row.peak_rss_kib << '\t' << row.work << '\t'
+		       << (row.unit.empty() ? "-" : row.unit) << '\t'
+		       << std::setprecision(0) << row.rate() << "\n";
+	}
+}
+
+// JSON の文字列として書く（名前は識別子と空白程度だが念のため）
+static void write_json_string(std::ostream &stream, std::string_view text) {
+	stream << '"';
+	for (const char c : text) {
+		if (c == '"' || c == '\\') {
+			stream << '\\' << c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			stream << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+			       << static_cast<int>(c) << std::dec << std::setfill(' ');
+		} else {
+			stream << c;
+		}
+	}
+	stream << '"';
+}
+
+void write_trace_json(std::ostream &stream) {
+	std::lock_guard lock(records_mutex);
+
+	stream << "{\"traceEvents\":[\n";
+	for (std::size_t i = 0; i < records.size(); ++i) {
+		const auto &record = records[i];
+		stream << "{\"name\":";
+		write_json_string(stream, record.name);
+		stream << ",\"cat\":";
+		write_json_string(stream, record.category);
+		stream << std::fixed << std::setprecision(3)
+		       << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << record.thread
+		       << ",\"ts\":" << record.start_us
+		       << ",\"dur\":" << record.duration_us
+		       << ",\"args\":{\"allocations\":" << record.allocation_count
+		       << ",\"allocated_bytes\":" << record.allocation_bytes
+		       << ",\"peak_rss_kib\":" << record.peak_rss_kib;
+		if (!record.unit.empty()) {
+			stream << ",";
+			write_json_string(stream, record.unit);
+			stream << ":" << record.work;
+		}
+		stream << "}}"
+		       << (i + 1 == records.size() ? "\n" : ",\n");
+	}
+	stream << "],\"displayTimeUnit\":\"ms\"}\n";
+}
@@ -0,0 +1,47 @@
+#ifndef INCLUDE_GUARD_TRACE_
+#define INCLUDE_GUARD_TRACE_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * instrumentation of compiler phases (--stats / --trace)
+ * while enabled, each TraceSpan records its wall time, the number and bytes
+ * of allocations made by its thread, and the peak RSS of the process
+ */
+void enable_tracing();
+bool tracing_enabled();
+
+class TraceSpan {
+private:
+	bool                                  active;
+	std::string                           name;
+	std::string                           category; // "phase" or "function"
+	std::chrono::steady_clock::time_point start;
+	std::uint64_t                         allocation_count;
+	std::uint64_t                         allocation_bytes;
+	std::uint64_t                         work = 0; // amount of work done
+	std::string                           unit;
+
+public:
+	// does nothing unless tracing is enabled
+	explicit TraceSpan(std::string_view name,
+	                   std::string_view category = "phase");
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+	~TraceSpan();
+
+	// record the work done in this span (e.g. 1200 "tokens") for throughput
+	void count(std::uint64_t amount, std::string_view unit);
+};
+
+// table of each phase (all functions are summed up into one row)
+void write_trace_summary(std::ostream &stream);
+// the same table as tab-separated values with a header line (--stats=tsv)
+void write_trace_tsv(std::ostream &stream);
+// Chrome trace_event format (chrome://tracing, Perfetto)
+void write_trace_json(std::ostream &stream);
+
+#endif
@@ -0,0 +1,229 @@
+#include "unroll.h"
+#include "assembly.h" // number_value
+#include "variables.h"
+#include <cassert>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+// 展開後の本体（と変化式）のノード数の上限
+static constexpr std::size_t max_unrolled_size = 64;
+// 全て展開するループの回数の上限
+static constexpr std::uint64_t max_full_trips = 16;
+
+namespace {
+// for (...; counter < limit; counter = counter + step)
+struct CountedLoop {
+	Symbol       counter;
+	const Node  *limit; // 数値か変数
+	std::int64_t step;  // 正の数
+};
+} // namespace
+
+static bool is_variable(const Node &node, Symbol name) {
+	return Node::node_type::identifier == node.type && node.value == name;
+}
+
+// 回数を数えるループの形なら、その変数と範囲
+static std::optional<CountedLoop> as_counted(const Node &loop,
+                                             const Variables &escaped) {
+	if (Node::node_type::for_ != loop.type) {
+		return std::nullopt;
+	}
+	assert(loop.child.size() == 4);
+	const auto &condition = *loop.child[1];
+	const auto &step      = *loop.child[2];
+
+	// counter < limit
+	if (Node::node_type::less != condition.type ||
+	    Node::node_type::identifier != condition.child[0]->type) {
+		return std::nullopt;
+	}
+	const auto  counter = condition.child[0]->value;
+	const auto &limit   = *condition.child[1];
+	if (Node::node_type::number != limit.type &&
+	    (Node::node_type::identifier != limit.type ||
+	     limit.value == counter)) {
+		return std::nullopt;
+	}
+
+	// counter = counter + step
+	if (Node::node_type::assign != step.type ||
+	    !is_variable(*step.child[0], counter) ||
+	    Node::node_type::addition != step.child[1]->type ||
+	    !is_variable(*step.child[1]->child[0], counter) ||
+	    Node::node_type::number != step.child[1]->child[1]->type ||
+	    number_value(step.child[1]->child[1]->value) <= 0) {
+		return std::nullopt;
+	}
+
+	// 本体は counter も limit も書き換えない
+	Variables assigned;
+	find_assigned(*loop.child[3], assigned);
+	const auto fixed = [&](Symbol variable) {
+		return !assigned.contains(variable) && !escaped.contains(variable);
+	};
+	if (!fixed(counter) ||
+	    (Node::node_type::identifier == limit.type && !fixed(limit.value))) {
+		return std::nullopt;
+	}
+
+	return CountedLoop{counter, &limit,
+	                   number_value(step.child[1]->child[1]->value)};
+}
+
+/**
+ * 初期値と上限が定数なら、本体を実行する回数
+ * （多すぎて数えられなければ nullopt）
+ */
+static std::optional<std::uint64_t> trip_count(const Node      &loop,
+                                               const CountedLoop &counted) {
+	const auto &initialization = *loop.child[0];
+	if (Node::node_type::assign != initialization.type ||
+	    !is_variable(*initialization.child[0], counted.counter) ||
+	    Node::node_type::number != initialization.child[1]->type ||
+	    Node::node_type::number != counted.limit->type) {
+		return std::nullopt;
+	}
+
+	const auto first = number_value(initialization.child[1]->value);
+	const auto limit = number_value(counted.limit->value);
+	if (limit <= first) {
+		return 0;
+	}
+	const auto distance = static_cast<std::uint64_t>(limit) -
+	                      static_cast<std::uint64_t>(first);
+	const auto step = static_cast<std::uint64_t>(counted.step);
+	return distance / step + (distance % step != 0 ? 1 : 0);
+}
+
+namespace {
+class Unroller {
+private:
+	SyntaxTree &tree;
+	std::size_t factor;
+	Variables   escaped; // 展開中の関数で & を取られた変数
+
+	Node *number(std::int64_t value) {
+		return tree.new_node(Node::node_type::number,
+		                     tree.intern(std::to_string(value)));
+	}
+
+	Node *unroll(Node &loop);
+
+public:
+	Unroller(SyntaxTree &tree, std::size_t factor)
+	    : tree(tree)
+	    , factor(factor) {}
+
+	void visit_function(Node &function) {
+		const auto variables = find_escaped(function);
+		escaped              = Variables(variables.begin(), variables.end());
+		visit(function.child[0]);
+	}
+
+	// 内側のループから順に（外側は大きくなった本体で判断する）
+	void visit(Node *&node) {
+		for (auto &child : node->child) {
+			visit(child);
+		}
+		if (const auto unrolled = unroll(*node)) {
+			node = unrolled;
+		}
+	}
+};
+} // namespace
+
+// 展開したループ（展開しないなら nullptr）
+Node *Unroller::unroll(Node &loop) {
+	const auto counted = as_counted(loop, escaped);
+	if (!counted) {
+		return nullptr;
+	}
+	auto      &body      = *loop.child[3];
+	auto      &step      = *loop.child[2];
+	const auto copy_size = count_nodes(body) + count_nodes(step);
+
+	/* { 初期化式; 本体; 変化式; 本体; 変化式; ... } */
+	if (const auto trips = trip_count(loop, *counted);
+	    trips && *trips <= max_full_trips &&
+	    *trips * copy_size <= max_unrolled_size) {
+		std::vector<Node *> statements{loop.child[0]};
+		for (std::uint64_t i = 0; i < *trips; ++i) {
+			statements.push_back(tree.copy(body));
+			statements.push_back(tree.copy(step));
+		}
+		return tree.new_node(Node::node_type::statements, statements);
+	}
+
+	/*
+	 * {
+	 *   初期化式;
+	 *   if (n >= INT64_MIN + d)       // n - d が溢れない時だけ（n が変数の時）
+	 *     for (; i < n - d; 変化式) { // d = (factor - 1) * c
+	 *       本体; 変化式; 本体; ...; 本体
+	 *     }
+	 *   for (; i < n; 変化式) 本体
+	 * }
+	 */
+	if (factor * copy_size > max_unrolled_size) {
+		return nullptr;
+	}
+	std::int64_t distance; // (factor - 1) * c
+	if (__builtin_mul_overflow(static_cast<std::int64_t>(factor - 1),
+	                           counted->step, &distance)) {
+		return nullptr;
+	}
+	Node *limit;
+	Node *guard = nullptr;
+	if (Node::node_type::number == counted->limit->type) {
+		std::int64_t value;
+		if (__builtin_sub_overflow(number_value(counted->limit->value),
+		                           distance, &value)) {
+			return nullptr;
+		}
+		limit = number(value);
+	} else {
+		// 演算は溢れると wrap するので、n - d が溢れる n では展開しない
+		constexpr auto minimum = std::numeric_limits<std::int64_t>::min();
+		Node *const operands[] = {tree.copy(*counted->limit), number(distance)};
+		Node *const bound[]    = {tree.copy(*counted->limit),
+		                          number(minimum + distance - 1)};
+		limit = tree.new_node(Node::node_type::subtraction, operands);
+		guard = tree.new_node(Node::node_type::greater, bound);
+	}
+
+	std::vector<Node *> copies;
+	for (std::size_t i = 0; i < factor; ++i) {
+		if (i != 0) {
+			copies.push_back(tree.copy(step));
+		}
+		copies.push_back(tree.copy(body));
+	}
+	Node *const comparison[] = {tree.copy(*loop.child[1]->child[0]), limit};
+	Node *const unrolled[]   = {tree.new_node(Node::node_type::empty),
+	                            tree.new_node(Node::node_type::less, comparison),
+	                            tree.copy(step),
+	                            tree.new_node(Node::node_type::statements, copies)};
+	Node *const remainder[]  = {tree.new_node(Node::node_type::empty),
+	                            loop.child[1], &step, &body};
+	Node *fast = tree.new_node(Node::node_type::for_, unrolled);
+	if (guard) {
+		Node *const children[] = {guard, fast};
+		fast = tree.new_node(Node::node_type::if_, children);
+	}
+	Node *const statements[] = {loop.child[0], fast,
+	                            tree.new_node(Node::node_type::for_, remainder)};
+	return tree.new_node(Node::node_type::statements, statements);
+}
+
+void unroll_loops(SyntaxTree &tree, std::size_t factor) {
+	if (factor <= 1) {
+		return;
+	}
+	Unroller unroller(tree, factor);
+	for (auto &function : tree.root->child) {
+		unroller.visit_function(*function);
+	}
+}
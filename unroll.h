@@ -0,0 +1,23 @@
+#ifndef INCLUDE_GUARD_UNROLL_
+#define INCLUDE_GUARD_UNROLL_
+
+#include "ast.h"
+#include <cstddef>
+
+// number of copies of the body of a counted loop by default
+constexpr std::size_t default_unroll_factor = 4;
+
+/**
+ * unroll counted loops for (...; i < n; i = i + c) (c a positive number,
+ * n a number or a variable; the loop assigns neither i nor n, and neither
+ * has its address taken)
+ * a loop with constant bounds and a few iterations is replaced with copies
+ * of its body; otherwise the body is repeated factor times in a loop that
+ * runs while i < n - (factor - 1) * c (entered only if that subtraction
+ * does not wrap), followed by the original loop for the remaining
+ * iterations
+ * (runs after fold_constants(); factor 1 disables)
+ */
+void unroll_loops(SyntaxTree &tree, std::size_t factor);
+
+#endif
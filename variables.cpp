@@ -0,0 +1,32 @@
+#include "variables.h"
+#include <cassert>
+
+static void find_escaped(const Node &node, Variables &found,
+                         std::vector<Symbol> &escaped) {
+	if (Node::node_type::address == node.type) {
+		assert(Node::node_type::identifier == node.child[0]->type);
+		if (found.insert(node.child[0]->value).second) {
+			escaped.push_back(node.child[0]->value);
+		}
+	}
+	for (const auto &child : node.child) {
+		find_escaped(*child, found, escaped);
+	}
+}
+
+std::vector<Symbol> find_escaped(const Node &node) {
+	Variables           found;
+	std::vector<Symbol> escaped;
+	find_escaped(node, found, escaped);
+	return escaped;
+}
+
+void find_assigned(const Node &node, Variables &assigned) {
+	if (Node::node_type::assign == node.type) {
+		assert(Node::node_type::identifier == node.child[0]->type);
+		assigned.insert(node.child[0]->value);
+	}
+	for (const auto &child : node.child) {
+		find_assigned(*child, assigned);
+	}
+}
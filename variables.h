@@ -0,0 +1,19 @@
+#ifndef INCLUDE_GUARD_VARIABLES_
+#define INCLUDE_GUARD_VARIABLES_
+
+#include "ast.h"
+#include <unordered_set>
+#include <vector>
+
+using Variables = std::unordered_set<Symbol>;
+
+/**
+ * variables whose address is taken with & in node, in order of first
+ * appearance (they can be read and written through pointers anywhere)
+ */
+std::vector<Symbol> find_escaped(const Node &node);
+
+// add the variables assigned with = in node to assigned
+void find_assigned(const Node &node, Variables &assigned);
+
+#endif
@@ -0,0 +1,209 @@
+#include "vm.h"
+#include "error.h"
+#include "jit.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace {
+// ローカル変数の領域（ネイティブのスタックの既定の大きさと同じ 8 MiB）
+constexpr std::size_t memory_slots = 1 << 20;
+// 計算途中の値のスタック
+constexpr std::size_t value_slots = 1 << 20;
+
+// 呼び出し元の状態
+struct CallFrame {
+	const BytecodeInstruction *return_pc;
+	unsigned char             *frame_end;
+};
+
+// 引数はレジスタで 6 個まで渡す（余分な引数は無視される）
+using ExternalFunction = long (*)(long, long, long, long, long, long);
+
+// 符号付きのオーバーフローはネイティブと同じく折り返す
+inline std::int64_t wrap(std::uint64_t value) {
+	return static_cast<std::int64_t>(value);
+}
+} // namespace
+
+long interpret(const BytecodeProgram &program) {
+	using opcode_type = BytecodeInstruction::opcode_type;
+
+	// C の関数は実行前に解決しておく
+	std::vector<ExternalFunction> externals;
+	for (const auto &external : program.externals) {
+		externals.push_back(
+		    reinterpret_cast<ExternalFunction>(resolve_external(external.name)));
+	}
+
+	std::vector<std::int64_t> memory(memory_slots);
+	std::vector<std::int64_t> values(value_slots);
+	std::vector<CallFrame>    calls;
+
+	const BytecodeInstruction *const code = program.code.data();
+	const BytecodeInstruction       *pc   = code;
+	std::int64_t *sp = values.data(); // 次に積む位置（先頭は sp[-1]）
+	auto *frame_end  = reinterpret_cast<unsigned char *>(memory.data());
+	std::int64_t result = 0; // set_result の値（return の無い関数の戻り値）
+
+	// 変数はネイティブと同じく [frame_end - offset] にある
+	const auto local = [&](std::int32_t offset) -> std::int64_t & {
+		return *reinterpret_cast<std::int64_t *>(frame_end - offset);
+	};
+
+	/**
+	 * 関数 index の呼び出し
+	 * 実引数は値スタックの先頭 arity 個（左から順）
+	 */
+	const auto enter = [&](std::size_t index, std::size_t arity,
+	                       const BytecodeInstruction *return_pc) {
+		const auto &callee = program.functions[index];
+		auto *const base   = reinterpret_cast<std::int64_t *>(frame_end);
+		if (base + callee.frame_slots > memory.data() + memory.size() ||
+		    sp + callee.max_stack > values.data() + values.size()) {
+			error("stack overflow in " + std::string(callee.name.str()));
+		}
+		sp -= arity;
+		calls.push_back({return_pc, frame_end});
+
+		frame_end = reinterpret_cast<unsigned char *>(base + callee.frame_slots);
+		std::fill(base, base + callee.frame_slots, 0);
+		const auto count = std::min(arity, callee.parameter_offsets.size());
+		for (std::size_t i = 0; i < count; ++i) {
+			local(callee.parameter_offsets[i]) = sp[i];
+		}
+		pc = code + callee.entry;
+	};
+
+	/* computed goto による直接の分岐（switch の 1 箇所の分岐より予測しやすい） */
+	static void *const labels[] = {
+	    &&op_constant,        &&op_load,          &&op_store,
+	    &&op_assign_statement, &&op_address,      &&op_indirection,
+	    &&op_negate,          &&op_add,           &&op_subtract,
+	    &&op_multiply,        &&op_divide,        &&op_equal,
+	    &&op_not_equal,       &&op_less,          &&op_less_equal,
+	    &&op_greater,         &&op_greater_equal, &&op_set_result,
+	    &&op_jump,            &&op_jump_if_zero,  &&op_jump_if_nonzero,
+	    &&op_call,            &&op_call_external, &&op_tail_call,
+	    &&op_return,          &&op_return_result};
+	static_assert(std::size(labels) ==
+	              static_cast<std::size_t>(opcode_type::count));
+
+#define DISPATCH() goto *labels[static_cast<std::size_t>(pc->opcode)]
+#define NEXT()      \
+	do {            \
+		++pc;       \
+		DISPATCH(); \
+	} while (0)
+#define BINARY(expression)                 \
+	do {                                   \
+		const std::int64_t right = sp[-1]; \
+		const std::int64_t left  = sp[-2]; \
+		sp[-2]                   = (expression); \
+		--sp;                              \
+		NEXT();                            \
+	} while (0)
+
+	std::int64_t value;
+	enter(program.main, 0, pc + 1); // main からの return で終わる
+	DISPATCH();
+
+op_constant:
+	*sp++ = program.constants[pc->operand];
+	NEXT();
+op_load:
+	*sp++ = local(pc->operand);
+	NEXT();
+op_store:
+	local(pc->operand) = sp[-1];
+	NEXT();
+op_assign_statement:
+	result = local(pc->operand) = *--sp;
+	NEXT();
+op_address:
+	*sp++ = reinterpret_cast<std::int64_t>(&local(pc->operand));
+	NEXT();
+op_indirection:
+	sp[-1] = *reinterpret_cast<const std::int64_t *>(sp[-1]);
+	NEXT();
+op_negate:
+	sp[-1] = wrap(0 - static_cast<std::uint64_t>(sp[-1]));
+	NEXT();
+op_add:
+	BINARY(wrap(static_cast<std::uint64_t>(left) + right));
+op_subtract:
+	BINARY(wrap(static_cast<std::uint64_t>(left) - right));
+op_multiply:
+	BINARY(wrap(static_cast<std::uint64_t>(left) * right));
+op_divide:
+	BINARY(left / right); // 0 除算はネイティブと同じく SIGFPE
+op_equal:
+	BINARY(left == right);
+op_not_equal:
+	BINARY(left != right);
+op_less:
+	BINARY(left < right);
+op_less_equal:
+	BINARY(left <= right);
+op_greater:
+	BINARY(left > right);
+op_greater_equal:
+	BINARY(left >= right);
+op_set_result:
+	result = *--sp;
+	NEXT();
+op_jump:
+	pc = code + pc->operand;
+	DISPATCH();
+op_jump_if_zero:
+	if (*--sp == 0) {
+		pc = code + pc->operand;
+		DISPATCH();
+	}
+	NEXT();
+op_jump_if_nonzero:
+	if (*--sp != 0) {
+		pc = code + pc->operand;
+		DISPATCH();
+	}
+	NEXT();
+op_call:
+	enter(pc->operand, pc->arity, pc + 1);
+	DISPATCH();
+op_tail_call: {
+	// 呼び出し元のフレームを畳んでから、同じ戻り先で呼ぶ
+	const auto caller = calls.back();
+	calls.pop_back();
+	frame_end = caller.frame_end;
+	enter(pc->operand, pc->arity, caller.return_pc);
+	DISPATCH();
+}
+op_call_external: {
+	long arguments[6] = {};
+	sp -= pc->arity;
+	std::copy(sp, sp + pc->arity, arguments);
+	*sp++ = externals[pc->operand](arguments[0], arguments[1], arguments[2],
+	                               arguments[3], arguments[4], arguments[5]);
+	NEXT();
+}
+op_return:
+	value = *--sp;
+	goto leave;
+op_return_result:
+	value = result;
+	goto leave;
+
+leave:
+	pc        = calls.back().return_pc;
+	frame_end = calls.back().frame_end;
+	calls.pop_back();
+	if (calls.empty()) {
+		return value;
+	}
+	*sp++ = value;
+	DISPATCH();
+
+#undef BINARY
+#undef NEXT
+#undef DISPATCH
+}
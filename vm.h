@@ -0,0 +1,12 @@
+#ifndef INCLUDE_GUARD_VM_
+#define INCLUDE_GUARD_VM_
+
+#include "bytecode.h"
+
+/**
+ * interpret bytecode (without assembling nor linking)
+ * returns the value returned by main
+ */
+long interpret(const BytecodeProgram &program);
+
+#endif